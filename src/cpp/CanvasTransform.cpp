@@ -0,0 +1,60 @@
+#include "CanvasTransform.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TRANSFORM_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_LANES 4
+#else
+#define TRANSFORM_LANES 1
+#endif
+
+st_canvasTransform makeCanvasTransform(int canvas_x, int canvas_y, int canvas_w, int canvasWidth) {
+    const float scale = (float) canvasWidth / (float) canvas_w;
+    return {scale, (float) -canvas_x * scale, (float) -canvas_y * scale};
+}
+
+// out[i] = in[i] * scale + offset
+static void scaleInts(const int32_t *in, float *out, size_t count, float scale, float offset) {
+    size_t i = 0;
+#if TRANSFORM_LANES == 8
+    const __m256 scales = _mm256_set1_ps(scale);
+    const __m256 offsets = _mm256_set1_ps(offset);
+    for (; i + 8 <= count; i += 8) {
+        const __m256 values = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *) (in + i)));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(values, scales), offsets));
+    }
+#elif TRANSFORM_LANES == 4
+    const __m128 scales = _mm_set1_ps(scale);
+    const __m128 offsets = _mm_set1_ps(offset);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 values = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) (in + i)));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(values, scales), offsets));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = (float) in[i] * scale + offset;
+    }
+}
+
+void CanvasTransformer::transform(const st_canvasTransform &transform, const PACKET *packets, size_t count,
+                                  st_canvasPoints &points) {
+    packetX.resize(count);
+    packetY.resize(count);
+    packetPressure.resize(count);
+    points.time.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        packetX[i] = (int32_t) packets[i].pkX;
+        packetY[i] = (int32_t) packets[i].pkY;
+        packetPressure[i] = (int32_t) packets[i].pkNormalPressure;
+        points.time[i] = packets[i].pkTime;
+    }
+
+    points.x.resize(count);
+    points.y.resize(count);
+    points.pressure.resize(count);
+    scaleInts(packetX.data(), points.x.data(), count, transform.scale, transform.offsetX);
+    scaleInts(packetY.data(), points.y.data(), count, transform.scale, transform.offsetY);
+    scaleInts(packetPressure.data(), points.pressure.data(), count, 1, 0);
+}
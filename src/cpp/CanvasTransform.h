@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Packet.h"
+
+#include <cstdint>
+#include <vector>
+
+// Maps packet coordinates (screen pixels) to canvas coordinates (background texture pixels).
+// The canvas keeps its aspect ratio, so one scale serves both axes: canvas = packet * scale + offset.
+struct st_canvasTransform {
+    float scale;
+    float offsetX;
+    float offsetY;
+};
+
+// canvas_x/canvas_y is the top left corner of the canvas on screen, canvas_w its width in screen pixels
+// and canvasWidth its width in canvas pixels.
+st_canvasTransform makeCanvasTransform(int canvas_x, int canvas_y, int canvas_w, int canvasWidth);
+
+// One drained batch of packets in canvas coordinates, one array per component.
+struct st_canvasPoints {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> pressure;
+    std::vector<DWORD> time;
+
+    size_t size() const {
+        return x.size();
+    }
+};
+
+// Converts every packet in the batch at once. Positions and pressure are first split into integer
+// arrays, then converted and scaled 8 (AVX) or 4 (SSE2) at a time, so the cost per packet stays flat
+// no matter how many arrive per frame. Timestamps are copied as they are.
+class CanvasTransformer {
+public:
+    void transform(const st_canvasTransform &transform, const PACKET *packets, size_t count,
+                   st_canvasPoints &points);
+
+private:
+    std::vector<int32_t> packetX;
+    std::vector<int32_t> packetY;
+    std::vector<int32_t> packetPressure;
+};
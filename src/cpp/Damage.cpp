@@ -0,0 +1,78 @@
+#include "Damage.h"
+
+#include <algorithm>
+
+static bool overlaps(const st_damageRect &a, const st_damageRect &b) {
+    return a.x <= b.x + b.w && b.x <= a.x + a.w && a.y <= b.y + b.h && b.y <= a.y + a.h;
+}
+
+static st_damageRect merge(const st_damageRect &a, const st_damageRect &b) {
+    const int left = std::min(a.x, b.x);
+    const int bottom = std::min(a.y, b.y);
+    const int right = std::max(a.x + a.w, b.x + b.w);
+    const int top = std::max(a.y + a.h, b.y + b.h);
+    return {left, bottom, right - left, top - bottom};
+}
+
+void DamageRegion::add(st_damageRect rect) {
+    if (wholeFramebuffer) {
+        return;
+    }
+    const int left = std::max(rect.x, 0);
+    const int bottom = std::max(rect.y, 0);
+    const int right = std::min(rect.x + rect.w, framebufferWidth);
+    const int top = std::min(rect.y + rect.h, framebufferHeight);
+    if (left >= right || bottom >= top) {
+        return;
+    }
+    rect = {left, bottom, right - left, top - bottom};
+
+    // merging can make the rectangle reach others it didn't before, so go around until nothing changes
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < rectCount; ++i) {
+            if (overlaps(damaged[i], rect)) {
+                rect = merge(damaged[i], rect);
+                damaged[i] = damaged[--rectCount];
+                merged = true;
+                break;
+            }
+        }
+    }
+    if (rectCount == DAMAGE_MAX_RECTS) {
+        for (int i = 1; i < rectCount; ++i) {
+            rect = merge(damaged[i], rect);
+        }
+        damaged[0] = merge(damaged[0], rect);
+        rectCount = 1;
+        return;
+    }
+    damaged[rectCount++] = rect;
+}
+
+void DamageRegion::addAll() {
+    wholeFramebuffer = true;
+    damaged[0] = {0, 0, framebufferWidth, framebufferHeight};
+    rectCount = framebufferWidth > 0 && framebufferHeight > 0 ? 1 : 0;
+}
+
+void DamageRegion::resize(int width, int height) {
+    framebufferWidth = width;
+    framebufferHeight = height;
+    addAll();
+}
+
+void DamageRegion::clear() {
+    if (rectCount > 0) {
+        damageStats.frames++;
+        if (wholeFramebuffer) {
+            damageStats.fullFrames++;
+        }
+        for (int i = 0; i < rectCount; ++i) {
+            damageStats.pixels += (uint64_t) damaged[i].w * (uint64_t) damaged[i].h;
+        }
+    }
+    rectCount = 0;
+    wholeFramebuffer = false;
+}
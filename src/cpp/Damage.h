@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#define DAMAGE_MAX_RECTS 8  // more than this and they are merged into one
+
+// A rectangle of the framebuffer in pixels, counted from the bottom left like glScissor takes it.
+struct st_damageRect {
+    int x, y, w, h;
+};
+
+struct st_damageStats {
+    uint64_t frames;      // frames composited
+    uint64_t fullFrames;  // of those, redrawn whole
+    uint64_t pixels;      // redrawn
+};
+
+// The parts of the window that changed since the last composite. Overlapping rectangles are merged as
+// they come in, so a stroke growing in one place stays one rectangle.
+class DamageRegion {
+public:
+    // Everything within rect, clipped to the framebuffer.
+    void add(st_damageRect rect);
+
+    // The whole framebuffer, after a resize or anything else that moves everything.
+    void addAll();
+
+    bool empty() const {
+        return rectCount == 0;
+    }
+
+    bool full() const {
+        return wholeFramebuffer;
+    }
+
+    const st_damageRect *rects(int *count) const {
+        *count = rectCount;
+        return damaged;
+    }
+
+    // The framebuffer is now width x height pixels, which damages all of it.
+    void resize(int width, int height);
+
+    // Takes the damage as composited and starts collecting again.
+    void clear();
+
+    const st_damageStats &stats() const {
+        return damageStats;
+    }
+
+private:
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    st_damageRect damaged[DAMAGE_MAX_RECTS] = {};
+    int rectCount = 0;
+    bool wholeFramebuffer = false;
+    st_damageStats damageStats = {};
+};
@@ -0,0 +1,379 @@
+#include "InkTiles.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+InkTiles::~InkTiles() {
+    destroy();
+}
+
+static unsigned int createTileArray(unsigned int format, int layerCount) {
+    unsigned int id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, format, INK_TILE_SIZE, INK_TILE_SIZE, layerCount);
+    return id;
+}
+
+bool InkTiles::create(int width, int height, unsigned int internalFormat, int budget, TileStore *tileStore) {
+    // a window that doesn't start on a tile edge reaches into one more tile
+    columns = (width + INK_TILE_SIZE - 1) / INK_TILE_SIZE + 1;
+    rows = (height + INK_TILE_SIZE - 1) / INK_TILE_SIZE + 1;
+    format = internalFormat;
+    store = tileStore;
+    tableLayers.assign((size_t) columns * rows, -1);
+
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (budget > 0) {
+        maxLayers = std::min(maxLayers, std::max(budget, columns * rows));
+    }
+
+    glGenTextures(1, &tableId);
+    glBindTexture(GL_TEXTURE_2D, tableId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, columns, rows, 0, GL_RED_INTEGER, GL_INT, tableLayers.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glGenFramebuffers(1, &fboId);
+
+    capacity = std::min(INK_TILE_FIRST_LAYERS, maxLayers);
+    arrayId = createTileArray(format, capacity);
+    freeLayers.clear();
+    for (int layer = capacity - 1; layer >= 0; --layer) {
+        freeLayers.push_back(layer);
+    }
+    return glGetError() == GL_NO_ERROR;
+}
+
+void InkTiles::destroy() {
+    for (const auto &readback : readbacks) {
+        glDeleteSync((GLsync) readback.second.fence);
+        freeBuffers.push_back(readback.second.pbo);
+    }
+    readbacks.clear();
+    if (!freeBuffers.empty()) {
+        glDeleteBuffers((int) freeBuffers.size(), freeBuffers.data());
+        freeBuffers.clear();
+    }
+    requested.clear();
+    if (fboId) {
+        glDeleteFramebuffers(1, &fboId);
+        fboId = 0;
+    }
+    if (arrayId) {
+        glDeleteTextures(1, &arrayId);
+        arrayId = 0;
+    }
+    if (tableId) {
+        glDeleteTextures(1, &tableId);
+        tableId = 0;
+    }
+    capacity = 0;
+    resident.clear();
+    freeLayers.clear();
+    tableLayers.clear();
+}
+
+void InkTiles::setWindow(int left, int bottom) {
+    const int windowLeft = inkTileOf(left);
+    const int windowBottom = inkTileOf(bottom);
+    if (windowLeft == tableLeft && windowBottom == tableBottom) {
+        return;
+    }
+    tableLeft = windowLeft;
+    tableBottom = windowBottom;
+
+    // the ones the window left can stay where they are, what comes back for them is ignored
+    std::erase_if(requested, [this](uint64_t key) { return !inWindow((int) (key >> 32), (int) (uint32_t) key); });
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            const int x = tableLeft + column;
+            const int y = tableBottom + row;
+            const uint64_t key = tileKey(x, y);
+            int &layer = tableLayers[(size_t) row * columns + column];
+            const auto found = resident.find(key);
+            if (found != resident.end()) {
+                layer = found->second.layer;
+                found->second.lastUse = ++useClock;
+            } else {
+                layer = -1;
+                // a readback is restored by update(), a stored tile shows up there once read
+                if (readbacks.count(key)) {
+                    requested.insert(key);
+                } else if (store && store->has(x, y) && requested.insert(key).second) {
+                    store->request(x, y);
+                }
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, tableId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, columns, rows, GL_RED_INTEGER, GL_INT, tableLayers.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
+
+bool InkTiles::grow() {
+    const int grown = std::min(capacity * 2, maxLayers);
+    if (grown <= capacity) {
+        return false;
+    }
+
+    const unsigned int grownId = createTileArray(format, grown);
+    glCopyImageSubData(arrayId, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, grownId, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+                       INK_TILE_SIZE, INK_TILE_SIZE, capacity);
+    glDeleteTextures(1, &arrayId);
+    arrayId = grownId;
+
+    for (int layer = grown - 1; layer >= capacity; --layer) {
+        freeLayers.push_back(layer);
+    }
+    capacity = grown;
+    return true;
+}
+
+bool InkTiles::evict() {
+    if (!store) {
+        return false;
+    }
+    auto oldest = resident.end();
+    for (auto tile = resident.begin(); tile != resident.end(); ++tile) {
+        const int x = (int) (tile->first >> 32);
+        const int y = (int) (uint32_t) tile->first;
+        if (!inWindow(x, y) && (oldest == resident.end() || tile->second.lastUse < oldest->second.lastUse)) {
+            oldest = tile;
+        }
+    }
+    if (oldest == resident.end()) {
+        return false;
+    }
+
+    // The GPU copies the tile into a pixel buffer, and update() hands that to the store once the copy is
+    // done. The layer can be drawn into again right away, the copy comes first.
+    st_readback &readback = readbacks[oldest->first];
+    readback.pbo = takeBuffer();
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, arrayId, 0, oldest->second.layer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glReadPixels(0, 0, INK_TILE_SIZE, INK_TILE_SIZE, GL_RED, format == GL_R16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,
+                 nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    freeLayers.push_back(oldest->second.layer);
+    resident.erase(oldest);
+    evictedTiles++;
+    return true;
+}
+
+int InkTiles::allocate() {
+    if (freeLayers.empty() && !grow() && !evict()) {
+        return -1;
+    }
+    const int layer = freeLayers.back();
+    freeLayers.pop_back();
+    return layer;
+}
+
+bool InkTiles::inWindow(int x, int y) const {
+    return x >= tableLeft && y >= tableBottom && x < tableLeft + columns && y < tableBottom + rows;
+}
+
+void InkTiles::setTableEntry(int x, int y, int layer) {
+    if (!inWindow(x, y)) {
+        return;
+    }
+    tableLayers[(size_t) (y - tableBottom) * columns + (x - tableLeft)] = layer;
+    glBindTexture(GL_TEXTURE_2D, tableId);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x - tableLeft, y - tableBottom, 1, 1, GL_RED_INTEGER, GL_INT, &layer);
+}
+
+void InkTiles::upload(int layer, const void *texels) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayId);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, INK_TILE_SIZE, INK_TILE_SIZE, 1, GL_RED,
+                    format == GL_R16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, texels);
+}
+
+// Fills layer from the pixel buffer the tile was evicted to, before it ever reached the store. The store
+// doesn't get that copy anymore, the tile is resident again.
+void InkTiles::restore(uint64_t key, int layer) {
+    const auto readback = readbacks.find(key);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, readback->second.pbo);
+    upload(layer, nullptr);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteSync((GLsync) readback->second.fence);
+    freeBuffers.push_back(readback->second.pbo);
+    readbacks.erase(readback);
+}
+
+// Hands the readbacks the GPU is done with to the store.
+void InkTiles::finishReadbacks() {
+    for (auto readback = readbacks.begin(); readback != readbacks.end();) {
+        const GLenum status = glClientWaitSync((GLsync) readback->second.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            ++readback;
+            continue;
+        }
+
+        const int x = (int) (readback->first >> 32);
+        const int y = (int) (uint32_t) readback->first;
+        std::vector<unsigned char> texels(tileBytes());
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->second.pbo);
+        const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) texels.size(), GL_MAP_READ_BIT);
+        if (mapped) {
+            std::memcpy(texels.data(), mapped, texels.size());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            store->write(x, y, std::move(texels));
+            // the window wants it back but there was no layer for it yet, it comes from the store now
+            if (requested.count(readback->first)) {
+                store->request(x, y);
+            }
+        } else {
+            std::cout << "Failed to read back ink tile " << x << ", " << y << std::endl;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        glDeleteSync((GLsync) readback->second.fence);
+        freeBuffers.push_back(readback->second.pbo);
+        readback = readbacks.erase(readback);
+    }
+}
+
+unsigned int InkTiles::takeBuffer() {
+    if (!freeBuffers.empty()) {
+        const unsigned int id = freeBuffers.back();
+        freeBuffers.pop_back();
+        return id;
+    }
+    unsigned int id;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, id);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) tileBytes(), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return id;
+}
+
+bool InkTiles::bindTile(int x, int y) {
+    const auto found = resident.find(tileKey(x, y));
+    int layer;
+    bool fresh = false;
+    if (found != resident.end()) {
+        layer = found->second.layer;
+        found->second.lastUse = ++useClock;
+    } else {
+        const uint64_t key = tileKey(x, y);
+        const bool evicted = readbacks.count(key) > 0;
+        if (!evicted && store && store->has(x, y)) {
+            // asked for when the window reached it, but not read yet
+            if (requested.insert(key).second) {
+                store->request(x, y);
+            }
+            return false;
+        }
+        layer = allocate();
+        if (layer < 0) {
+            std::cout << "Out of ink tiles, " << capacity << " in use" << std::endl;
+            return false;
+        }
+        if (evicted) {
+            restore(key, layer);
+        } else {
+            fresh = true;
+        }
+        requested.erase(key);
+        resident[key] = {layer, ++useClock};
+        setTableEntry(x, y, layer);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, arrayId, 0, layer);
+    glViewport(0, 0, INK_TILE_SIZE, INK_TILE_SIZE);
+    if (fresh) {
+        // whatever the layer held before it was freed
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    return true;
+}
+
+bool InkTiles::update() {
+    if (!store) {
+        return false;
+    }
+    bool shown = false;
+    // tiles the window came back to before they made it to the store
+    for (auto key = requested.begin(); key != requested.end();) {
+        if (!readbacks.count(*key)) {
+            ++key;
+            continue;
+        }
+        const int layer = allocate();
+        if (layer < 0) {
+            break;
+        }
+        restore(*key, layer);
+        resident[*key] = {layer, ++useClock};
+        setTableEntry((int) (*key >> 32), (int) (uint32_t) *key, layer);
+        key = requested.erase(key);
+        shown = true;
+    }
+
+    finishReadbacks();
+
+    store->takeLoaded(loadedTiles);
+    for (const st_storedTile &tile : loadedTiles) {
+        // ones the window left meanwhile can stay stored, and ones that couldn't be read are lost
+        if (!requested.erase(tileKey(tile.x, tile.y)) || tile.texels.empty()) {
+            continue;
+        }
+        const int layer = allocate();
+        if (layer < 0) {
+            continue;
+        }
+        upload(layer, tile.texels.data());
+        resident[tileKey(tile.x, tile.y)] = {layer, ++useClock};
+        setTableEntry(tile.x, tile.y, layer);
+        shown = true;
+    }
+    return shown;
+}
+
+void InkTiles::clear() {
+    for (const auto &tile : resident) {
+        freeLayers.push_back(tile.second.layer);
+    }
+    resident.clear();
+    for (const auto &readback : readbacks) {
+        glDeleteSync((GLsync) readback.second.fence);
+        freeBuffers.push_back(readback.second.pbo);
+    }
+    readbacks.clear();
+    requested.clear();
+    if (store) {
+        store->clear();
+    }
+    tableLayers.assign(tableLayers.size(), -1);
+    glBindTexture(GL_TEXTURE_2D, tableId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, columns, rows, GL_RED_INTEGER, GL_INT, tableLayers.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
+
+size_t InkTiles::texelBytes() const {
+    return format == GL_R16 ? 2 : 1;
+}
+
+size_t InkTiles::tileBytes() const {
+    return (size_t) INK_TILE_SIZE * INK_TILE_SIZE * texelBytes();
+}
+
+size_t InkTiles::bytes() const {
+    return (size_t) capacity * tileBytes();
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "TileStore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define INK_TILE_SIZE 256  // pixels on each side, compositeFragment.glsl assumes it
+#define INK_TILE_FIRST_LAYERS 16  // tiles room is made for up front, doubled whenever it runs out
+
+// Tile of an ink layer pixel, rounding down for pixels left of or below the origin.
+inline int inkTileOf(int pixel) {
+    return (pixel >= 0 ? pixel : pixel - INK_TILE_SIZE + 1) / INK_TILE_SIZE;
+}
+
+// The ink layer cut into square tiles, only the ones ink has touched are stored. Tiles live in the layers
+// of one texture array. A table texture tells the compositor which layer holds each tile of a window
+// around the view, or -1 for tiles that were never inked and read as no coverage. Layers of freed tiles
+// go on a free list and are handed out again before the array grows.
+// Tile (x, y) covers ink layer pixels from (x, y) * INK_TILE_SIZE, rows counted up from the bottom of the
+// canvas like the other layers. Tile coordinates can be any int, so the layer has no edges.
+// With a budget, the array stops growing there; the tiles outside the window that were drawn into least
+// recently then make room by going to a TileStore, which reads them back when the window reaches them.
+// Neither way waits: an evicted tile is copied into a pixel buffer and handed to the store once the GPU is
+// done with the copy, and stored tiles are asked for as soon as the window moves over them.
+class InkTiles {
+public:
+    ~InkTiles();
+
+    // Tiles for a window of width x height pixels, internalFormat being a single channel like GL_R8.
+    // budget is the most tiles kept in GPU memory, 0 for no limit, and needs a store. It is raised to
+    // what the window can show at once if lower.
+    bool create(int width, int height, unsigned int internalFormat, int budget = 0, TileStore *store = nullptr);
+
+    void destroy();
+
+    // Moves the window so its bottom left corner is ink layer pixel (left, bottom). Stored tiles in it are
+    // asked for and show up once read back, see update().
+    void setWindow(int left, int bottom);
+
+    // Binds a framebuffer drawing into tile (x, y), allocating the tile if it has no layer yet. A new tile
+    // is cleared, so the scissor test has to be off. False if no layer could be made for it, or if the tile
+    // is still on its way back from the store; nothing should be drawn while loading().
+    bool bindTile(int x, int y);
+
+    // Hands finished evictions to the store and takes in the tiles it has read back. True if the window
+    // shows any new tiles.
+    bool update();
+
+    // Tiles in the window that were stored and haven't been brought back by update() yet.
+    int loading() const {
+        return (int) requested.size();
+    }
+
+    // Frees every tile, the layer reads as empty again.
+    void clear();
+
+    // GL_TEXTURE_2D_ARRAY with a layer per tile
+    unsigned int tiles() const {
+        return arrayId;
+    }
+
+    // GL_R32I texture, the layer of each tile in the window or -1
+    unsigned int table() const {
+        return tableId;
+    }
+
+    // tile at the bottom left of the table
+    int tableX() const {
+        return tableLeft;
+    }
+
+    int tableY() const {
+        return tableBottom;
+    }
+
+    int allocated() const {
+        return capacity - (int) freeLayers.size();
+    }
+
+    // texture memory the layers take, whether allocated or not
+    size_t bytes() const;
+
+    // tiles moved out to the store
+    uint64_t evicted() const {
+        return evictedTiles;
+    }
+
+private:
+    struct st_residentTile {
+        int layer;
+        uint64_t lastUse;
+    };
+
+    // An evicted tile the GPU is copying into pbo, handed to the store once fence has signalled.
+    struct st_readback {
+        unsigned int pbo;
+        void *fence;
+    };
+
+    bool grow();
+
+    bool evict();
+
+    int allocate();
+
+    bool inWindow(int x, int y) const;
+
+    void setTableEntry(int x, int y, int layer);
+
+    // texels in client memory, or an offset into the bound pixel unpack buffer
+    void upload(int layer, const void *texels);
+
+    void restore(uint64_t key, int layer);
+
+    void finishReadbacks();
+
+    unsigned int takeBuffer();
+
+    size_t texelBytes() const;
+
+    size_t tileBytes() const;
+
+    int columns = 0;  // of the table
+    int rows = 0;
+    int tableLeft = 0;
+    int tableBottom = 0;
+    unsigned int format = 0;
+    unsigned int arrayId = 0;
+    unsigned int tableId = 0;
+    unsigned int fboId = 0;
+    int capacity = 0;
+    int maxLayers = 0;
+    TileStore *store = nullptr;
+    std::unordered_map<uint64_t, st_residentTile> resident;
+    std::vector<int> freeLayers;
+    std::vector<int> tableLayers;  // row by row
+    uint64_t useClock = 0;
+    uint64_t evictedTiles = 0;
+    std::vector<st_storedTile> loadedTiles;
+    std::unordered_map<uint64_t, st_readback> readbacks;
+    std::vector<unsigned int> freeBuffers;  // pixel buffers of finished readbacks
+    // Tiles the window needs back, stored or still being read back. Each has a request with the store
+    // that is still out, or a readback, since a tile only gets written again after it was brought back.
+    std::unordered_set<uint64_t> requested;
+};
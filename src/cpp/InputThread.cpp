@@ -0,0 +1,101 @@
+#include "InputThread.h"
+
+#include <chrono>
+
+// packets requested from the source per call; the thread keeps calling until the source is empty
+#define INPUT_BATCH 64
+// longest the thread blocks in a source that can wait for packets, which is also how long stop() can take
+#define INPUT_WAIT_TIMEOUT_MS 50
+// how long to sleep when the source has nothing for us and can't be waited on
+#define INPUT_POLL_INTERVAL std::chrono::milliseconds(1)
+// once nothing has come in for INPUT_IDLE_AFTER polls (the pen is away) the thread polls this often instead;
+// the driver keeps queueing meanwhile, so only the first packet of the next stroke can be late
+#define INPUT_IDLE_POLL_INTERVAL std::chrono::milliseconds(4)
+#define INPUT_IDLE_AFTER 500
+
+InputThread::InputThread(PacketSource *source, size_t ringCapacity, bool waitWhenFull, void (*notify)())
+        : source(source), ring(ringCapacity), waitWhenFull(waitWhenFull), notify(notify) {}
+
+InputThread::~InputThread() {
+    stop();
+}
+
+void InputThread::start() {
+    running = true;
+    thread = std::thread(&InputThread::run, this);
+}
+
+void InputThread::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+size_t InputThread::drain(std::vector<PACKET> &packets) {
+    // cleared before popping: anything pushed after this point notifies again
+    notified.exchange(false, std::memory_order_acq_rel);
+    return ring.popAll(packets);
+}
+
+st_inputStats InputThread::stats() const {
+    return {
+            received.load(std::memory_order_relaxed),
+            dropped.load(std::memory_order_relaxed),
+            ring.size(),
+            highWater.load(std::memory_order_relaxed),
+            ring.capacity()
+    };
+}
+
+void InputThread::wake() {
+    if (notify && !notified.exchange(true, std::memory_order_acq_rel)) {
+        notify();
+    }
+}
+
+void InputThread::run() {
+    PACKET batch[INPUT_BATCH];
+    int idlePolls = 0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        const int count = source->getPackets(batch, INPUT_BATCH);
+
+        if (count > 0) {
+            idlePolls = 0;
+            size_t pushed = ring.push(batch, count);
+            wake();
+            while (waitWhenFull && pushed < (size_t) count && running.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(INPUT_POLL_INTERVAL);
+                pushed += ring.push(batch + pushed, count - pushed);
+                wake();
+            }
+            received.fetch_add(count, std::memory_order_relaxed);
+            if (pushed < (size_t) count) {
+                dropped.fetch_add(count - pushed, std::memory_order_relaxed);
+            }
+
+            const size_t occupancy = ring.size();
+            if (occupancy > highWater.load(std::memory_order_relaxed)) {
+                highWater.store(occupancy, std::memory_order_relaxed);
+            }
+
+            // a full batch means the source probably has more queued up, so go again right away
+            if (count == INPUT_BATCH) {
+                continue;
+            }
+        } else if (source->finished()) {
+            sourceFinished.store(true, std::memory_order_release);
+            if (notify) {
+                notify();
+            }
+            break;
+        } else if (idlePolls < INPUT_IDLE_AFTER) {
+            idlePolls++;
+        }
+
+        if (!source->waitForPackets(INPUT_WAIT_TIMEOUT_MS)) {
+            std::this_thread::sleep_for(idlePolls < INPUT_IDLE_AFTER ? INPUT_POLL_INTERVAL : INPUT_IDLE_POLL_INTERVAL);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "PacketRing.h"
+#include "PacketSource.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Counters published by the input thread. Safe to read from any thread.
+struct st_inputStats {
+    uint64_t received;   // packets pulled from the source
+    uint64_t dropped;    // packets lost because the ring was full
+    size_t occupancy;    // packets currently waiting in the ring
+    size_t highWater;    // highest occupancy seen so far
+    size_t capacity;
+};
+
+// Pulls packets from a PacketSource on its own thread so acquisition never waits on rendering.
+// The thread sleeps in the source until packets arrive when the source supports it, and polls otherwise.
+// The render loop takes everything that arrived since the last call with drain().
+// Live input drops packets when the ring is full; with waitWhenFull the thread waits for room
+// instead, so replays stay complete and deterministic.
+// notify, if given, is called from the input thread when packets arrive while the consumer is caught up,
+// and once more when the source finishes, so the consumer can sleep in between.
+class InputThread {
+public:
+    InputThread(PacketSource *source, size_t ringCapacity, bool waitWhenFull, void (*notify)() = nullptr);
+
+    ~InputThread();
+
+    void start();
+
+    void stop();
+
+    // Appends every pending packet to packets. Returns how many were appended.
+    size_t drain(std::vector<PACKET> &packets);
+
+    // True once the source is exhausted and every packet it produced has been drained.
+    bool finished() const {
+        return sourceFinished.load(std::memory_order_acquire) && ring.size() == 0;
+    }
+
+    st_inputStats stats() const;
+
+private:
+    void run();
+
+    void wake();
+
+    PacketSource *source;
+    PacketRing<PACKET> ring;
+    bool waitWhenFull;
+    void (*notify)();
+    // set once notify has been called, cleared by drain(), so a burst of packets wakes the consumer only once
+    std::atomic<bool> notified = false;
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::atomic<bool> sourceFinished = false;
+
+    std::atomic<uint64_t> received = 0;
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<size_t> highWater = 0;
+};
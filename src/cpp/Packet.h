@@ -0,0 +1,103 @@
+#pragma once
+// Packet layout requested from the tablet context. Every translation unit that touches PACKET
+// must include this header so they all agree on the generated struct.
+// Only the fields the pipeline reads: anything more is copied out of the driver queue, through the
+// input ring and into session files for nothing.
+#define PACKETDATA (PK_TIME | PK_X | PK_Y | PK_NORMAL_PRESSURE)
+#define PACKETMODE 0
+#include "Utils.h"
+#include <wacom-wintab/PKTDEF.H>
+
+#include <cstddef>
+#include <cstring>
+
+// Where PKTDEF.H puts each field for a given mask. The fields it knows follow each other in bit order,
+// each aligned to its own type, so the layout of any mask can be worked out without generating its struct.
+constexpr size_t packetFieldSize(WTPKT field) {
+    switch (field) {
+        case PK_CONTEXT:
+            return sizeof(HCTX);
+        case PK_TIME:
+            return sizeof(DWORD);
+        case PK_CHANGED:
+            return sizeof(WTPKT);
+        case PK_BUTTONS:
+            return sizeof(DWORD);
+        case PK_X:
+        case PK_Y:
+        case PK_Z:
+            return sizeof(LONG);
+        case PK_ORIENTATION:
+            return sizeof(ORIENTATION);
+        case PK_ROTATION:
+            return sizeof(ROTATION);
+        default:  // status, serial number, cursor and both pressures are UINT (int when relative)
+            return sizeof(UINT);
+    }
+}
+
+constexpr size_t packetFieldAlignment(WTPKT field) {
+    return field == PK_CONTEXT ? alignof(HCTX) : field == PK_ORIENTATION ? alignof(ORIENTATION) :
+                                                 field == PK_ROTATION ? alignof(ROTATION) : packetFieldSize(field);
+}
+
+// Byte offset of field in a packet of mask, or the packet size if field is not in mask.
+constexpr size_t packetFieldOffset(WTPKT mask, WTPKT field) {
+    size_t offset = 0;
+    size_t alignment = 1;
+    for (WTPKT bit = PK_CONTEXT; bit <= PK_ROTATION; bit <<= 1) {
+        if (!(mask & bit)) {
+            continue;
+        }
+        const size_t fieldAlignment = packetFieldAlignment(bit);
+        offset = (offset + fieldAlignment - 1) / fieldAlignment * fieldAlignment;
+        if (bit == field) {
+            return offset;
+        }
+        offset += packetFieldSize(bit);
+        alignment = fieldAlignment > alignment ? fieldAlignment : alignment;
+    }
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+constexpr size_t packetSize(WTPKT mask) {
+    return packetFieldOffset(mask, 0);
+}
+
+// The worked out layout has to be the one PKTDEF.H generated, or decoding recorded packets goes wrong.
+static_assert(packetFieldOffset(PACKETDATA, PK_TIME) == offsetof(PACKET, pkTime), "pkTime moved");
+static_assert(packetFieldOffset(PACKETDATA, PK_X) == offsetof(PACKET, pkX), "pkX moved");
+static_assert(packetFieldOffset(PACKETDATA, PK_Y) == offsetof(PACKET, pkY), "pkY moved");
+static_assert(packetFieldOffset(PACKETDATA, PK_NORMAL_PRESSURE) == offsetof(PACKET, pkNormalPressure),
+              "pkNormalPressure moved");
+static_assert(packetSize(PACKETDATA) == sizeof(PACKET), "PACKET has fields the layout doesn't know about");
+// and the layout itself against a wider mask, the one the first session files were recorded with
+static_assert(packetSize(PK_TIME | PK_BUTTONS | PK_X | PK_Y | PK_NORMAL_PRESSURE | PK_TANGENT_PRESSURE) == 24,
+              "wrong size for the old session layout");
+static_assert(packetFieldOffset(PK_TIME | PK_BUTTONS | PK_X | PK_Y | PK_NORMAL_PRESSURE, PK_X) == 8,
+              "wrong offset for the old session layout");
+
+// Reads the fields PACKET has out of packets laid out for another mask, such as session files recorded
+// before the mask changed. Only works if that mask has all of them.
+struct st_packetDecoder {
+    size_t size;
+    size_t time, x, y, pressure;
+
+    PACKET decode(const unsigned char *raw) const {
+        PACKET pkt = {};
+        std::memcpy(&pkt.pkTime, raw + time, sizeof(pkt.pkTime));
+        std::memcpy(&pkt.pkX, raw + x, sizeof(pkt.pkX));
+        std::memcpy(&pkt.pkY, raw + y, sizeof(pkt.pkY));
+        std::memcpy(&pkt.pkNormalPressure, raw + pressure, sizeof(pkt.pkNormalPressure));
+        return pkt;
+    }
+};
+
+constexpr bool packetDecodable(WTPKT mask) {
+    return (mask & PACKETDATA) == PACKETDATA;
+}
+
+constexpr st_packetDecoder makePacketDecoder(WTPKT mask) {
+    return {packetSize(mask), packetFieldOffset(mask, PK_TIME), packetFieldOffset(mask, PK_X),
+            packetFieldOffset(mask, PK_Y), packetFieldOffset(mask, PK_NORMAL_PRESSURE)};
+}
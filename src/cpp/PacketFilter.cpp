@@ -0,0 +1,46 @@
+#include "PacketFilter.h"
+
+void PacketFilter::filter(st_canvasPoints &points) {
+    const size_t count = points.size();
+    filterStats.received += count;
+    if (threshold <= 0) {
+        filterStats.forwarded += count;
+        return;
+    }
+
+    const float thresholdSquared = threshold * threshold;
+    size_t kept = 0;
+    size_t i = 0;
+    while (i < count) {
+        const float anchorX = points.x[i];
+        const float anchorY = points.y[i];
+        const bool contact = points.pressure[i] > 0;
+        float pressure = points.pressure[i];
+
+        size_t next = i + 1;
+        while (next < count && (points.pressure[next] > 0) == contact) {
+            const float dx = points.x[next] - anchorX;
+            const float dy = points.y[next] - anchorY;
+            if (dx * dx + dy * dy >= thresholdSquared) {
+                break;
+            }
+            if (points.pressure[next] > pressure) {
+                pressure = points.pressure[next];
+            }
+            next++;
+        }
+
+        points.x[kept] = anchorX;
+        points.y[kept] = anchorY;
+        points.pressure[kept] = pressure;
+        points.time[kept] = points.time[i];
+        kept++;
+        i = next;
+    }
+
+    points.x.resize(kept);
+    points.y.resize(kept);
+    points.pressure.resize(kept);
+    points.time.resize(kept);
+    filterStats.forwarded += kept;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CanvasTransform.h"
+
+#include <cstdint>
+
+struct st_filterStats {
+    uint64_t received;   // points handed to filter()
+    uint64_t forwarded;  // points left after merging
+};
+
+// Dead-zone filter between the canvas transform and stamping. High report rates produce runs of packets
+// that barely move; each run closer than the threshold (canvas pixels) to its first packet is merged
+// into that packet, keeping the highest pressure of the run. Runs never cross a pen down or pen up, and
+// never span two batches, so filtering adds no latency.
+class PacketFilter {
+public:
+    // a threshold of 0 or less lets every point through
+    explicit PacketFilter(float threshold) : threshold(threshold) {}
+
+    // Merges the batch in place.
+    void filter(st_canvasPoints &points);
+
+    const st_filterStats &stats() const {
+        return filterStats;
+    }
+
+private:
+    float threshold;
+    st_filterStats filterStats = {};
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two so indices can be masked instead of wrapped.
+template<typename T>
+class PacketRing {
+public:
+    explicit PacketRing(size_t minCapacity) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        items.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    size_t capacity() const {
+        return items.size();
+    }
+
+    // Number of items waiting to be popped. Exact from either side, a snapshot from anywhere else.
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Producer side. Copies as many of the count items as fit and returns how many were pushed.
+    size_t push(const T *values, size_t count) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        const size_t free = capacity() - (h - tail.load(std::memory_order_acquire));
+        if (count > free) {
+            count = free;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            items[(h + i) & mask] = values[i];
+        }
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Appends everything currently in the ring to out and returns how many were popped.
+    size_t popAll(std::vector<T> &out) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t count = head.load(std::memory_order_acquire) - t;
+        for (size_t i = 0; i < count; ++i) {
+            out.push_back(items[(t + i) & mask]);
+        }
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask;
+
+    // producer and consumer indices live on separate cache lines so they don't false share
+    alignas(64) std::atomic<size_t> head = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+};
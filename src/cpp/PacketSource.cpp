@@ -0,0 +1,324 @@
+#include "PacketSource.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include "WintabEvdev.h"
+
+#include <ctime>
+#endif
+
+#define SESSION_MAGIC "BANS"
+#define SESSION_VERSION 1
+
+// the driver queue holds this many drain intervals worth of packets
+#define WINTAB_QUEUE_HEADROOM 4
+#define WINTAB_QUEUE_MIN 16
+#define WINTAB_QUEUE_MAX 4096
+// a drain that returns more than this fraction of the queue grows it
+#define WINTAB_QUEUE_GROW_THRESHOLD 0.75
+// weight of the newest interval in the smoothed drain interval
+#define WINTAB_DRAIN_SMOOTHING 0.1
+
+// Current time on the clock pkTime uses: system milliseconds on Windows, CLOCK_MONOTONIC on the evdev backend.
+static DWORD packetClockNow() {
+#ifdef _WIN32
+    return GetTickCount();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+#endif
+}
+
+WintabPacketSource::~WintabPacketSource() {
+    if (hctx) {
+        gpWTClose(hctx);
+    }
+    UnloadWintab();
+}
+
+bool WintabPacketSource::open(HWND hwnd, double frameTime) {
+    if (!LoadWintab()) {
+        std::cout << "Failed to initialize WINTAB" << std::endl;
+        return false;
+    }
+
+    LOGCONTEXT lcMine = {0};
+    AXIS tabletX = {0};
+    AXIS tabletY = {0};
+    if (gpWTInfoA(WTI_DEFSYSCTX, 0, &lcMine) > 0) {
+        UINT result;
+        gpWTInfoA(WTI_DEVICES, DVC_HARDWARE, &result);
+        bool displayTablet = result & HWC_INTEGRATED;
+
+        gpWTInfoA(WTI_DEVICES, DVC_PKTRATE, &pktRate);
+        std::cout << "pktrate: " << pktRate << std::endl;
+
+        char name[1024] = {};
+        gpWTInfoA(WTI_DEVICES, DVC_NAME, name);
+        std::cout << "name: " << name << std::endl;
+
+        std::cout << "type: " << (displayTablet ? "display (integrated)" : "opaque") << std::endl;
+
+        lcMine.lcPktData = PACKETDATA;
+        lcMine.lcOptions |= CXO_MESSAGES;
+        lcMine.lcOptions |= CXO_SYSTEM;  // move system cursor
+        lcMine.lcPktMode = PACKETMODE;
+        lcMine.lcMoveMask = PACKETDATA;
+        lcMine.lcBtnUpMask = lcMine.lcBtnDnMask;
+
+        // Set the entire tablet as active
+        UINT wWTInfoRetVal = gpWTInfoA(WTI_DEVICES, DVC_X, &tabletX);
+        if (wWTInfoRetVal != sizeof(AXIS)) {
+            std::cout << "This context should not be opened. ?????" << std::endl;
+        } else {
+            gpWTInfoA(WTI_DEVICES, DVC_Y, &tabletY);
+            gpWTInfoA(WTI_DEVICES, DVC_NPRESSURE, &pressure);
+            std::cout << "x: " << tabletX.axMin << ", " << tabletX.axMax << std::endl;
+            std::cout << "y: " << tabletY.axMin << ", " << tabletY.axMax << std::endl;
+            std::cout << "pressure: " << pressure.axMin << ", " << pressure.axMax << std::endl;
+
+            // In Wintab, the tablet origin is lower left. Move origin to upper left so that it coincides with screen origin.
+            lcMine.lcOutExtY = -lcMine.lcOutExtY;
+
+            hctx = gpWTOpenA(hwnd, &lcMine, true);
+        }
+    }
+
+    if (!hctx) {
+        std::cout << "Failed to initialize WINTAB context" << std::endl;
+        return false;
+    }
+
+    // Until drains have been timed, assume they come a frame apart. Enough room for a few of those before
+    // anybody drains the queue.
+    queueMetrics.drainInterval = frameTime;
+    queueLimit = WINTAB_QUEUE_MAX;
+    if (!setQueueSize(targetQueueSize())) {
+        std::cout << "Failed to set WINTAB queue size" << std::endl;
+        return false;
+    }
+    std::cout << "queue size: " << queueMetrics.queueSize << std::endl;
+    return true;
+}
+
+// Asks for size packets, halving until the driver accepts. Sizes it refused are not asked for again.
+bool WintabPacketSource::setQueueSize(int size) {
+    if (size > queueLimit) {
+        size = queueLimit;
+    }
+    for (; size >= WINTAB_QUEUE_MIN; size /= 2) {
+        if (gpWTQueueSizeSet(hctx, size)) {
+            queueMetrics.queueSize = size;
+            return true;
+        }
+        queueLimit = size / 2;
+    }
+    return false;
+}
+
+// Room for a few drain intervals worth of packets, the intervals as they have been lately.
+int WintabPacketSource::targetQueueSize() const {
+    const int size = (int) std::ceil(pktRate * queueMetrics.drainInterval * WINTAB_QUEUE_HEADROOM);
+    return size < WINTAB_QUEUE_MIN ? WINTAB_QUEUE_MIN : size;
+}
+
+int WintabPacketSource::getPackets(PACKET *packets, int maxPackets) {
+    if (pendingNext >= pending.size()) {
+        drainQueue();
+    }
+
+    size_t count = pending.size() - pendingNext;
+    if (count > (size_t) maxPackets) {
+        count = maxPackets;
+    }
+    std::memcpy(packets, pending.data() + pendingNext, count * sizeof(PACKET));
+    pendingNext += count;
+    return (int) count;
+}
+
+bool WintabPacketSource::waitForPackets(int timeoutMs) {
+#ifdef _WIN32
+    return false;
+#else
+    if (pendingNext < pending.size()) {
+        return true;
+    }
+    const bool waited = EvdevWaitForPackets(hctx, timeoutMs);
+    // nothing sat in the queue while we were blocked, so that time isn't part of a drain interval
+    lastDrain = std::chrono::steady_clock::now();
+    return waited;
+#endif
+}
+
+// Empties the whole driver queue in one call so its fill level tells us whether it is big enough.
+void WintabPacketSource::drainQueue() {
+    const auto now = std::chrono::steady_clock::now();
+    if (drainedBefore) {
+        const double interval = std::chrono::duration<double>(now - lastDrain).count();
+        queueMetrics.drainInterval = queueMetrics.drainInterval * (1 - WINTAB_DRAIN_SMOOTHING) +
+                                     interval * WINTAB_DRAIN_SMOOTHING;
+    }
+    drainedBefore = true;
+    lastDrain = now;
+
+    const int queueSize = queueMetrics.queueSize;
+    pending.resize(queueSize);
+    const int count = gpWTPacketsGet(hctx, queueSize, (LPVOID) pending.data());
+    pending.resize(count > 0 ? count : 0);
+    pendingNext = 0;
+    if (count <= 0) {
+        return;
+    }
+
+    accountPackets(pending.data(), count);
+
+    if (count == queueSize) {
+        queueMetrics.fullDrains++;
+    }
+
+    // Drains coming further apart than the queue was sized for grow it before it overflows, a nearly full
+    // drain grows it regardless. It never shrinks again.
+    int wanted = targetQueueSize();
+    if (count >= queueSize * WINTAB_QUEUE_GROW_THRESHOLD && wanted < queueSize * 2) {
+        wanted = queueSize * 2;
+    }
+    if (wanted > queueSize && queueSize < queueLimit) {
+        // resizing flushes the queue, which we just emptied anyway
+        if (!setQueueSize(wanted)) {
+            setQueueSize(queueSize);
+        }
+        if (queueMetrics.queueSize > queueSize) {
+            queueMetrics.growths++;
+        }
+    }
+}
+
+void WintabPacketSource::accountPackets(const PACKET *packets, int count) {
+    const DWORD now = packetClockNow();
+    const DWORD period = pktRate > 0 ? 1000 / pktRate : 0;
+    // A packet that waited longer than a drain interval sat through a drain it should have made. A packet
+    // period and a millisecond of clock rounding on top, packets arriving just after a drain aren't late.
+    const DWORD lateAfter = (DWORD) std::ceil(queueMetrics.drainInterval * 1000) + period + 1;
+
+    for (int i = 0; i < count; ++i) {
+        const PACKET &pkt = packets[i];
+        const bool inContact = pkt.pkNormalPressure > 0;
+
+        // the driver only reports changes, but a pen on the surface always changes something,
+        // so a gap of several periods mid-stroke means packets fell out of a full queue
+        if (period > 0 && lastInContact && inContact) {
+            const DWORD gap = pkt.pkTime - lastPktTime;
+            if (gap > 2 * period) {
+                queueMetrics.dropped += gap / period - 1;
+            }
+        }
+        if ((DWORD) (now - pkt.pkTime) > lateAfter && (DWORD) (now - pkt.pkTime) < 0x80000000u) {
+            queueMetrics.late++;
+        }
+
+        lastPktTime = pkt.pkTime;
+        lastInContact = inContact;
+    }
+}
+
+bool ReplayPacketSource::open(const char *file, bool paced) {
+    this->paced = paced;
+
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        std::cout << "Failed to open session file: " << file << std::endl;
+        return false;
+    }
+
+    st_sessionHeader header = {};
+    in.read((char *) &header, sizeof(header));
+    if (!in || std::memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) != 0) {
+        std::cout << "Not a session file: " << file << std::endl;
+        return false;
+    }
+    // older recordings asked the driver for more fields, decode the ones still used out of those
+    if (header.version != SESSION_VERSION || !packetDecodable(header.packetData) ||
+        header.packetSize != packetSize(header.packetData)) {
+        std::cout << "Session file was recorded with a different packet layout: " << file << std::endl;
+        return false;
+    }
+    pressure = header.pressure;
+
+    if (header.packetData == PACKETDATA) {
+        PACKET pkt;
+        while (in.read((char *) &pkt, sizeof(PACKET))) {
+            packets.push_back(pkt);
+        }
+    } else {
+        const st_packetDecoder decoder = makePacketDecoder(header.packetData);
+        std::vector<unsigned char> raw(decoder.size);
+        while (in.read((char *) raw.data(), (std::streamsize) raw.size())) {
+            packets.push_back(decoder.decode(raw.data()));
+        }
+    }
+    next = 0;
+    started = false;
+    return true;
+}
+
+int ReplayPacketSource::getPackets(PACKET *out, int maxPackets) {
+    if (finished()) {
+        return 0;
+    }
+
+    if (!started) {
+        startTime = std::chrono::steady_clock::now();
+        started = true;
+    }
+
+    size_t end = next + maxPackets;
+    if (end > packets.size()) {
+        end = packets.size();
+    }
+
+    if (paced) {
+        // pkTime is in milliseconds and may wrap, so compare offsets from the first packet
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - startTime).count();
+        const DWORD firstTime = packets[0].pkTime;
+        size_t due = next;
+        while (due < end && (DWORD) (packets[due].pkTime - firstTime) <= (uint64_t) elapsed) {
+            due++;
+        }
+        end = due;
+    }
+
+    const int count = (int) (end - next);
+    std::memcpy(out, packets.data() + next, count * sizeof(PACKET));
+    next = end;
+    return count;
+}
+
+bool RecordingPacketSource::open(const char *file) {
+    out.open(file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << "Failed to create session file: " << file << std::endl;
+        return false;
+    }
+
+    st_sessionHeader header = {};
+    std::memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.version = SESSION_VERSION;
+    header.packetData = PACKETDATA;
+    header.packetSize = sizeof(PACKET);
+    header.pressure = source->pressureAxis();
+    out.write((const char *) &header, sizeof(header));
+    return true;
+}
+
+int RecordingPacketSource::getPackets(PACKET *packets, int maxPackets) {
+    const int count = source->getPackets(packets, maxPackets);
+    if (count > 0) {
+        out.write((const char *) packets, count * sizeof(PACKET));
+    }
+    return count;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Packet.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+// Something that produces tablet packets for the inking pipeline.
+class PacketSource {
+public:
+    virtual ~PacketSource() = default;
+
+    // Copies up to maxPackets pending packets into packets. Returns how many were copied.
+    virtual int getPackets(PACKET *packets, int maxPackets) = 0;
+
+    // Range of pkNormalPressure values this source reports.
+    virtual AXIS pressureAxis() const = 0;
+
+    // True once the source will never produce another packet.
+    virtual bool finished() const {
+        return false;
+    }
+
+    // Blocks until packets may be ready or timeoutMs passes, whichever comes first. Returns false without
+    // waiting if the source has nothing to block on, in which case the caller has to poll.
+    virtual bool waitForPackets(int timeoutMs) {
+        return false;
+    }
+};
+
+// Health of the Wintab packet queue. Written by the thread calling getPackets(),
+// so only read it once that thread has stopped.
+struct st_queueMetrics {
+    int queueSize;          // packets the driver queue holds
+    int growths;            // times the queue had to be enlarged
+    uint64_t fullDrains;    // drains that found the queue completely full
+    uint64_t dropped;       // packets estimated missing from gaps in pkTime
+    uint64_t late;          // packets already older than drainInterval when drained
+    double drainInterval;   // smoothed time between drains, in seconds
+};
+
+// Live packets from the Wintab driver.
+// The driver queue is sized from the device packet rate and how far apart drains have been coming, and
+// grown whenever drains slow down or one finds it nearly full.
+class WintabPacketSource : public PacketSource {
+public:
+    ~WintabPacketSource() override;
+
+    // frameTime is how long the app expects to go between drains, until drains have been timed
+    bool open(HWND hwnd, double frameTime);
+
+    int getPackets(PACKET *packets, int maxPackets) override;
+
+    // Blocks on the device on the evdev backend. Wintab only announces packets to the window's own thread,
+    // so there it doesn't wait.
+    bool waitForPackets(int timeoutMs) override;
+
+    AXIS pressureAxis() const override {
+        return pressure;
+    }
+
+    const st_queueMetrics &metrics() const {
+        return queueMetrics;
+    }
+
+private:
+    bool setQueueSize(int size);
+
+    int targetQueueSize() const;
+
+    void drainQueue();
+
+    void accountPackets(const PACKET *packets, int count);
+
+    HCTX hctx = nullptr;
+    AXIS pressure = {0};
+    UINT pktRate = 0;
+    int queueLimit = 0;  // the driver refused anything larger
+
+    // packets taken from the driver but not handed out yet
+    std::vector<PACKET> pending;
+    size_t pendingNext = 0;
+
+    bool drainedBefore = false;
+    std::chrono::steady_clock::time_point lastDrain;
+    DWORD lastPktTime = 0;
+    bool lastInContact = false;
+    st_queueMetrics queueMetrics = {};
+};
+
+// Header written at the start of a recorded session file, followed by the raw PACKETs.
+struct st_sessionHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t packetData;
+    uint32_t packetSize;
+    AXIS pressure;
+};
+
+// Plays back a session recorded by RecordingPacketSource.
+// When paced, packets are released following their original pkTime spacing,
+// otherwise everything is handed out as fast as the caller asks for it.
+class ReplayPacketSource : public PacketSource {
+public:
+    bool open(const char *file, bool paced);
+
+    int getPackets(PACKET *packets, int maxPackets) override;
+
+    AXIS pressureAxis() const override {
+        return pressure;
+    }
+
+    bool finished() const override {
+        return next >= packets.size();
+    }
+
+    size_t packetCount() const {
+        return packets.size();
+    }
+
+private:
+    std::vector<PACKET> packets;
+    size_t next = 0;
+    bool paced = true;
+    bool started = false;
+    std::chrono::steady_clock::time_point startTime;
+    AXIS pressure = {0};
+};
+
+// Forwards packets from another source and appends them to a session file.
+class RecordingPacketSource : public PacketSource {
+public:
+    explicit RecordingPacketSource(std::unique_ptr<PacketSource> source) : source(std::move(source)) {}
+
+    bool open(const char *file);
+
+    int getPackets(PACKET *packets, int maxPackets) override;
+
+    AXIS pressureAxis() const override {
+        return source->pressureAxis();
+    }
+
+    bool finished() const override {
+        return source->finished();
+    }
+
+    bool waitForPackets(int timeoutMs) override {
+        return source->waitForPackets(timeoutMs);
+    }
+
+private:
+    std::unique_ptr<PacketSource> source;
+    std::ofstream out;
+};
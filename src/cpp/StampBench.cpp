@@ -0,0 +1,196 @@
+// Times the stamp generator against the one-stamp-at-a-time loop it replaced, on long, fast strokes.
+// Usage: stamp_bench [--segments N] [--length PIXELS] [--spacing PIXELS]
+
+#include "StampGenerator.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// how many times every run is repeated, the fastest one counts
+#define BENCH_REPEATS 5
+
+// Hands out room from a vector that is big enough up front, like the stamp stream does from its region.
+class VectorSink : public StampSink {
+public:
+    explicit VectorSink(size_t capacity) : stamps(capacity) {}
+
+    st_inkData *reserve(size_t count, size_t *granted) override {
+        const size_t left = stamps.size() - used;
+        *granted = count < left ? count : left;
+        return stamps.data() + used;
+    }
+
+    void commit(size_t count) override {
+        used += count;
+    }
+
+    void clear() {
+        used = 0;
+        resetBounds();
+    }
+
+    std::vector<st_inkData> stamps;
+    size_t used = 0;
+};
+
+struct st_benchSegment {
+    st_inputPoint from;
+    st_inputPoint to;
+    float startTangentX, startTangentY;
+    float endTangentX, endTangentY;
+};
+
+// The spacing loop as it was, a division and a trip through the sink per stamp.
+static float scalarStamps(const st_benchSegment &segment, float spacing, float leftoverDistance,
+                          VectorSink &sink) {
+    const st_inputPoint &prev = segment.from;
+    const st_inputPoint &point = segment.to;
+    const float dist = std::sqrt((point.x - prev.x) * (point.x - prev.x) + (point.y - prev.y) * (point.y - prev.y));
+    float count = 1;
+    while (spacing * count <= dist + leftoverDistance) {
+        const float t = (spacing * count - leftoverDistance) / dist;
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        const float h00 = 2 * t3 - 3 * t2 + 1;
+        const float h10 = t3 - 2 * t2 + t;
+        const float h01 = -2 * t3 + 3 * t2;
+        const float h11 = t3 - t2;
+        const st_inkData fillerInk = {
+                h00 * prev.x + h10 * segment.startTangentX + h01 * point.x + h11 * segment.endTangentX,
+                h00 * prev.y + h10 * segment.startTangentY + h01 * point.y + h11 * segment.endTangentY,
+                prev.pressure + (point.pressure - prev.pressure) * t
+        };
+        size_t granted;
+        *sink.reserve(1, &granted) = fillerInk;
+        sink.commit(1);
+        sink.include(fillerInk);
+
+        count++;
+    }
+    return leftoverDistance + dist - spacing * (count - 1);
+}
+
+// The same stamps through the generator, the way StrokeBuilder calls it.
+static float generatedStamps(const st_benchSegment &segment, float spacing, float leftoverDistance,
+                             VectorSink &sink) {
+    const st_inputPoint &prev = segment.from;
+    const st_inputPoint &point = segment.to;
+    const float dist = std::sqrt((point.x - prev.x) * (point.x - prev.x) + (point.y - prev.y) * (point.y - prev.y));
+    const size_t count = (size_t) ((dist + leftoverDistance) / spacing);
+    if (count > 0) {
+        const st_stampCurve curve = makeStampCurve(prev, point, segment.startTangentX, segment.startTangentY,
+                                                   segment.endTangentX, segment.endTangentY);
+        size_t granted;
+        st_inkData *out = sink.reserve(count, &granted);
+        sink.include(generateStamps(curve, (spacing - leftoverDistance) / dist, spacing / dist, granted, out));
+        sink.commit(granted);
+    }
+    return leftoverDistance + dist - spacing * (float) count;
+}
+
+struct st_benchResult {
+    double total;  // seconds
+    double worst;  // slowest segment, seconds
+    size_t stamps;
+};
+
+template<typename Generate>
+static st_benchResult run(const std::vector<st_benchSegment> &segments, float spacing, VectorSink &sink,
+                          Generate generate) {
+    st_benchResult best = {1e30, 1e30, 0};
+    for (int repeat = 0; repeat < BENCH_REPEATS; ++repeat) {
+        sink.clear();
+        float leftoverDistance = 0;
+        double worst = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (const st_benchSegment &segment : segments) {
+            const auto segmentStart = std::chrono::steady_clock::now();
+            leftoverDistance = generate(segment, spacing, leftoverDistance, sink);
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - segmentStart).count();
+            if (elapsed > worst) {
+                worst = elapsed;
+            }
+        }
+        const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (total < best.total) {
+            best = {total, worst, sink.used};
+        }
+    }
+    return best;
+}
+
+static void print(const char *name, const st_benchResult &result) {
+    std::cout << name << ": " << result.stamps << " stamps in " << result.total * 1000 << " ms, "
+              << result.total * 1e9 / (double) result.stamps << " ns per stamp, slowest segment "
+              << result.worst * 1e6 << " us" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int segmentCount = 20000;
+    float length = 150;
+    float spacing = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--segments") == 0 && i + 1 < argc) {
+            segmentCount = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            length = (float) std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--spacing") == 0 && i + 1 < argc) {
+            spacing = (float) std::atof(argv[++i]);
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--segments N] [--length PIXELS] [--spacing PIXELS]" << std::endl;
+            return -1;
+        }
+    }
+    if (segmentCount <= 0 || length <= 0 || spacing <= 0) {
+        std::cout << "Segments, length and spacing must be positive" << std::endl;
+        return -1;
+    }
+
+    // a fast circle-ish scribble: every segment is length pixels long and turns a little, like a flick of
+    // the pen sampled at a low report rate
+    std::vector<st_benchSegment> segments(segmentCount);
+    st_inputPoint point = {1000, 1000, 512, 0};
+    float angle = 0;
+    for (st_benchSegment &segment : segments) {
+        const float turn = 0.3f;
+        segment.from = point;
+        point.x += std::cos(angle) * length;
+        point.y += std::sin(angle) * length;
+        point.pressure = 512 + 400 * std::sin(angle * 0.7f);
+        point.time += 5;
+        segment.to = point;
+        segment.startTangentX = std::cos(angle - turn / 2) * length;
+        segment.startTangentY = std::sin(angle - turn / 2) * length;
+        segment.endTangentX = std::cos(angle + turn / 2) * length;
+        segment.endTangentY = std::sin(angle + turn / 2) * length;
+        angle += turn;
+    }
+
+    const size_t capacity = (size_t) ((float) segmentCount * (length * 1.1f / spacing + 1));
+    VectorSink scalarSink(capacity);
+    VectorSink generatedSink(capacity);
+    const st_benchResult scalar = run(segments, spacing, scalarSink, scalarStamps);
+    const st_benchResult generated = run(segments, spacing, generatedSink, generatedStamps);
+    print("Scalar loop", scalar);
+    print("Generator  ", generated);
+    std::cout << "Speedup: " << scalar.total / generated.total << "x" << std::endl;
+
+    // both should land the same stamps, give or take float rounding
+    const size_t compared = scalar.stamps < generated.stamps ? scalar.stamps : generated.stamps;
+    float maxDifference = 0;
+    for (size_t i = 0; i < compared; ++i) {
+        const float difference = std::fabs(scalarSink.stamps[i].x - generatedSink.stamps[i].x) +
+                                 std::fabs(scalarSink.stamps[i].y - generatedSink.stamps[i].y);
+        if (difference > maxDifference) {
+            maxDifference = difference;
+        }
+    }
+    std::cout << "Stamp count difference: " << (long long) generated.stamps - (long long) scalar.stamps
+              << ", largest position difference: " << maxDifference << " px" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "StampGenerator.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define STAMP_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STAMP_LANES 4
+#else
+#define STAMP_LANES 1
+#endif
+
+st_stampCurve makeStampCurve(const st_inputPoint &from, const st_inputPoint &to, float startTangentX,
+                             float startTangentY, float endTangentX, float endTangentY) {
+    // the Hermite basis functions multiplied out
+    return {
+            {from.x, startTangentX, 3 * (to.x - from.x) - 2 * startTangentX - endTangentX,
+             2 * (from.x - to.x) + startTangentX + endTangentX},
+            {from.y, startTangentY, 3 * (to.y - from.y) - 2 * startTangentY - endTangentY,
+             2 * (from.y - to.y) + startTangentY + endTangentY},
+            {from.pressure, to.pressure - from.pressure}
+    };
+}
+
+st_inkData stampAt(const st_stampCurve &curve, float t) {
+    return {
+            ((curve.x[3] * t + curve.x[2]) * t + curve.x[1]) * t + curve.x[0],
+            ((curve.y[3] * t + curve.y[2]) * t + curve.y[1]) * t + curve.y[0],
+            curve.size[1] * t + curve.size[0]
+    };
+}
+
+st_stampBounds generateStamps(const st_stampCurve &curve, float firstT, float stepT, size_t count,
+                              st_inkData *out) {
+    st_stampBounds bounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0};
+    size_t i = 0;
+
+#if STAMP_LANES > 1
+    // the lanes compute components side by side, then the stamps are put together from them
+    alignas(32) float xs[STAMP_LANES], ys[STAMP_LANES], sizes[STAMP_LANES];
+#if STAMP_LANES == 8
+#define LANES __m256
+#define LANE_SET1 _mm256_set1_ps
+#define LANE_ADD _mm256_add_ps
+#define LANE_MUL _mm256_mul_ps
+#define LANE_MIN _mm256_min_ps
+#define LANE_MAX _mm256_max_ps
+#define LANE_STORE _mm256_store_ps
+    const LANES laneOffsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+#else
+#define LANES __m128
+#define LANE_SET1 _mm_set1_ps
+#define LANE_ADD _mm_add_ps
+#define LANE_MUL _mm_mul_ps
+#define LANE_MIN _mm_min_ps
+#define LANE_MAX _mm_max_ps
+#define LANE_STORE _mm_store_ps
+    const LANES laneOffsets = _mm_setr_ps(0, 1, 2, 3);
+#endif
+    const LANES steps = LANE_SET1(stepT);
+    const LANES x0 = LANE_SET1(curve.x[0]), x1 = LANE_SET1(curve.x[1]), x2 = LANE_SET1(curve.x[2]), x3 = LANE_SET1(curve.x[3]);
+    const LANES y0 = LANE_SET1(curve.y[0]), y1 = LANE_SET1(curve.y[1]), y2 = LANE_SET1(curve.y[2]), y3 = LANE_SET1(curve.y[3]);
+    const LANES size0 = LANE_SET1(curve.size[0]), size1 = LANE_SET1(curve.size[1]);
+    LANES minX = LANE_SET1(FLT_MAX), minY = LANE_SET1(FLT_MAX);
+    LANES maxX = LANE_SET1(-FLT_MAX), maxY = LANE_SET1(-FLT_MAX), maxSize = LANE_SET1(0);
+
+    for (; i + STAMP_LANES <= count; i += STAMP_LANES) {
+        const LANES t = LANE_ADD(LANE_SET1(firstT + (float) i * stepT), LANE_MUL(laneOffsets, steps));
+        const LANES x = LANE_ADD(LANE_MUL(LANE_ADD(LANE_MUL(LANE_ADD(LANE_MUL(x3, t), x2), t), x1), t), x0);
+        const LANES y = LANE_ADD(LANE_MUL(LANE_ADD(LANE_MUL(LANE_ADD(LANE_MUL(y3, t), y2), t), y1), t), y0);
+        const LANES size = LANE_ADD(LANE_MUL(size1, t), size0);
+        minX = LANE_MIN(minX, x);
+        minY = LANE_MIN(minY, y);
+        maxX = LANE_MAX(maxX, x);
+        maxY = LANE_MAX(maxY, y);
+        maxSize = LANE_MAX(maxSize, size);
+
+        LANE_STORE(xs, x);
+        LANE_STORE(ys, y);
+        LANE_STORE(sizes, size);
+        for (int lane = 0; lane < STAMP_LANES; ++lane) {
+            out[i + lane] = {xs[lane], ys[lane], sizes[lane]};
+        }
+    }
+
+    alignas(32) float minXs[STAMP_LANES], minYs[STAMP_LANES];
+    alignas(32) float maxXs[STAMP_LANES], maxYs[STAMP_LANES], maxSizes[STAMP_LANES];
+    LANE_STORE(minXs, minX);
+    LANE_STORE(minYs, minY);
+    LANE_STORE(maxXs, maxX);
+    LANE_STORE(maxYs, maxY);
+    LANE_STORE(maxSizes, maxSize);
+    for (int lane = 0; lane < STAMP_LANES; ++lane) {
+        bounds.minX = std::min(bounds.minX, minXs[lane]);
+        bounds.minY = std::min(bounds.minY, minYs[lane]);
+        bounds.maxX = std::max(bounds.maxX, maxXs[lane]);
+        bounds.maxY = std::max(bounds.maxY, maxYs[lane]);
+        bounds.maxSize = std::max(bounds.maxSize, maxSizes[lane]);
+    }
+#undef LANES
+#undef LANE_SET1
+#undef LANE_ADD
+#undef LANE_MUL
+#undef LANE_MIN
+#undef LANE_MAX
+#undef LANE_STORE
+#endif
+
+    for (; i < count; ++i) {
+        out[i] = stampAt(curve, firstT + (float) i * stepT);
+        bounds.minX = std::min(bounds.minX, out[i].x);
+        bounds.minY = std::min(bounds.minY, out[i].y);
+        bounds.maxX = std::max(bounds.maxX, out[i].x);
+        bounds.maxY = std::max(bounds.maxY, out[i].y);
+        bounds.maxSize = std::max(bounds.maxSize, out[i].size);
+    }
+    return bounds;
+}
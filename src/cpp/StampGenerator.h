@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Stroke.h"
+
+#include <cstddef>
+
+// A stretch of stroke as polynomials in t, which goes from 0 at its start to 1 at its end. Coefficients
+// are lowest power first: the position is a cubic, the size (pressure) a straight line.
+struct st_stampCurve {
+    float x[4];
+    float y[4];
+    float size[2];
+};
+
+// The cubic Hermite curve from one sample to the next, tangents already scaled to the segment duration.
+st_stampCurve makeStampCurve(const st_inputPoint &from, const st_inputPoint &to, float startTangentX,
+                             float startTangentY, float endTangentX, float endTangentY);
+
+// The stamp at t, one at a time.
+st_inkData stampAt(const st_stampCurve &curve, float t);
+
+// Writes count stamps to out, at t = firstT, firstT + stepT, firstT + 2 * stepT and so on, and returns
+// their bounds. count must be at least one.
+// The curve is evaluated for 8 (AVX) or 4 (SSE2) stamps at a time, so a long, fast segment costs a few
+// multiply-adds per stamp instead of a division and a round trip through the sink each.
+st_stampBounds generateStamps(const st_stampCurve &curve, float firstT, float stepT, size_t count,
+                              st_inkData *out);
@@ -0,0 +1,125 @@
+#include "StreamBuffer.h"
+
+#include <glad/glad.h>
+
+// how long to wait for the GPU at a time, in nanoseconds
+#define STREAM_FENCE_TIMEOUT 100000000
+
+StreamBuffer::~StreamBuffer() {
+    destroy();
+}
+
+bool StreamBuffer::create(size_t size, size_t elements, int regions) {
+    elementSize = size;
+    regionElements = elements;
+    regionCount = regions;
+    region = 0;
+    cursor = 0;
+    fences = new void *[regionCount]();
+
+    const GLsizeiptr bufferSize = (GLsizeiptr) (elementSize * regionElements * regionCount);
+    glGenBuffers(1, &bufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+    if (GLAD_GL_VERSION_4_4) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, bufferSize, nullptr, flags);
+        mapped = (unsigned char *) glMapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize, flags);
+        return mapped != nullptr;
+    }
+    glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+    return glGetError() == GL_NO_ERROR;
+}
+
+void StreamBuffer::destroy() {
+    if (fences) {
+        for (int i = 0; i < regionCount; ++i) {
+            if (fences[i]) {
+                glDeleteSync((GLsync) fences[i]);
+            }
+        }
+        delete[] fences;
+        fences = nullptr;
+    }
+    if (bufferId) {
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &bufferId);
+        bufferId = 0;
+    }
+}
+
+void *StreamBuffer::reserve(size_t count, size_t *granted, size_t *first) {
+    *granted = count < available() ? count : available();
+    *first = region * regionElements + cursor;
+    if (mapped) {
+        return mapped + *first * elementSize;
+    }
+
+    // the fences already keep the GPU off this range, so the map doesn't need to sync either
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+    return glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr) (*first * elementSize), (GLsizeiptr) (*granted * elementSize),
+                            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void StreamBuffer::commit(size_t used) {
+    cursor += used;
+    if (!mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+}
+
+void StreamBuffer::nextRegion() {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % regionCount;
+    cursor = 0;
+
+    GLsync fence = (GLsync) fences[region];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_FENCE_TIMEOUT);
+        while (status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(fence, 0, STREAM_FENCE_TIMEOUT);
+        }
+        glDeleteSync(fence);
+        fences[region] = nullptr;
+    }
+}
+
+st_inkData *StampStream::reserve(size_t count, size_t *granted) {
+    if (buffer.available() == 0) {
+        // whatever was written to this region has to be drawn before it gets fenced
+        flush();
+        buffer.nextRegion();
+    } else if (batchLimit > 0 && pendingCount >= batchLimit) {
+        flush();
+    }
+    if (batchLimit > 0 && count > batchLimit - pendingCount) {
+        count = batchLimit - pendingCount;
+    }
+    count = grantable(count);
+    size_t first;
+    void *room = buffer.reserve(count, granted, &first);
+    if (pendingCount == 0) {
+        pendingFirst = first;
+    }
+    return (st_inkData *) room;
+}
+
+void StampStream::commit(size_t used) {
+    buffer.commit(used);
+    pendingCount += used;
+    charge(used);
+}
+
+size_t StampStream::flush() {
+    const size_t count = pendingCount;
+    if (count > 0) {
+        draw(pendingFirst, count, bounds());
+        pendingCount = 0;
+        resetBounds();
+    }
+    return count;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Stroke.h"
+
+#include <cstddef>
+#include <functional>
+
+// Vertex buffer for data written once by the CPU and drawn once by the GPU, every frame.
+// The buffer is split into regions used one after the other. Leaving a region puts a fence behind the
+// commands that read it, and a region is only written again once its fence has passed, so writes never
+// race the GPU and the driver never has to reallocate or sync.
+// With GL 4.4 the buffer is created with glBufferStorage and stays mapped (persistent, coherent), so
+// data is written straight into memory the GPU reads. Older contexts map each reservation unsynchronized.
+class StreamBuffer {
+public:
+    ~StreamBuffer();
+
+    // Creates the buffer and binds it to GL_ARRAY_BUFFER.
+    bool create(size_t elementSize, size_t regionElements, int regionCount);
+
+    void destroy();
+
+    unsigned int buffer() const {
+        return bufferId;
+    }
+
+    bool persistent() const {
+        return mapped != nullptr;
+    }
+
+    // Elements left in the current region.
+    size_t available() const {
+        return regionElements - cursor;
+    }
+
+    // Room for up to count elements in the current region, which must have some left. *granted is set to how
+    // many fit and *first to the index of the first one in the buffer, for the draw call.
+    void *reserve(size_t count, size_t *granted, size_t *first);
+
+    // The first used elements of the last reservation were written.
+    void commit(size_t used);
+
+    // Fences the current region and moves on to the next one, waiting for the GPU if it still reads from it.
+    // Everything drawn from the current region must have been submitted before.
+    void nextRegion();
+
+private:
+    unsigned int bufferId = 0;
+    unsigned char *mapped = nullptr;
+    size_t elementSize = 0;
+    size_t regionElements = 0;
+    int regionCount = 0;
+
+    int region = 0;
+    size_t cursor = 0;
+    // one per region, null while the region isn't waiting on the GPU
+    void **fences = nullptr;
+};
+
+// StampSink writing straight into a StreamBuffer. Written stamps are handed to draw (first, count, bounds)
+// on flush() and whenever the region fills up, so callers can generate any number of stamps.
+class StampStream : public StampSink {
+public:
+    // With a batchLimit, stamps are drawn at least every batchLimit stamps so each batch covers a small area.
+    StampStream(StreamBuffer &buffer,
+                std::function<void(size_t first, size_t count, const st_stampBounds &bounds)> draw,
+                size_t batchLimit = 0)
+            : buffer(buffer), draw(std::move(draw)), batchLimit(batchLimit) {}
+
+    st_inkData *reserve(size_t count, size_t *granted) override;
+
+    void commit(size_t used) override;
+
+    // Draws the stamps written since the last flush, if any. Returns how many there were.
+    size_t flush();
+
+private:
+    StreamBuffer &buffer;
+    std::function<void(size_t first, size_t count, const st_stampBounds &bounds)> draw;
+    size_t batchLimit;
+    size_t pendingFirst = 0;
+    size_t pendingCount = 0;
+};
@@ -0,0 +1,338 @@
+#include "Stroke.h"
+
+#include "StampGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+
+// samples that move less than this fraction of the spacing without changing pressure are dropped
+#define REDUNDANT_DISTANCE 0.1f
+// predictions never reach further than this, in milliseconds
+#define PREDICTION_MAX_AHEAD 50.0f
+// the predicted path is walked in this many straight steps
+#define PREDICTION_STEPS 8
+// acceleration is noisy at tablet sampling rates, only part of it is trusted
+#define PREDICTION_ACCELERATION 0.5f
+// capsules are split until the curve strays less than this from them, in canvas pixels
+#define CAPSULE_TOLERANCE 0.25f
+#define CAPSULE_MAX_PIECES 16
+
+static float module(float x, float y) {
+    return std::sqrt(x * x + y * y);
+}
+
+// Writes stamps one by one into whatever room the sink hands out, asking for more as it fills up.
+class StampWriter {
+public:
+    explicit StampWriter(StampSink &sink) : sink(sink) {}
+
+    ~StampWriter() {
+        if (out) {
+            sink.commit(used);
+        }
+    }
+
+    // expected is how many stamps are still to come including this one, a hint for how much room to ask for
+    void add(const st_inkData &stamp, size_t expected) {
+        if (used == granted) {
+            if (out) {
+                sink.commit(used);
+            }
+            out = sink.reserve(expected > 0 ? expected : 1, &granted);
+            used = 0;
+        }
+        out[used++] = stamp;
+        sink.include(stamp);
+    }
+
+    // Both ends go in one reservation. Sinks hand out room in pairs as long as everything written to them
+    // is a capsule, so a capsule never straddles two reservations.
+    void addCapsule(const st_inkData &from, const st_inkData &to, size_t expected) {
+        if (granted - used < 2) {
+            if (out) {
+                sink.commit(used);
+            }
+            out = sink.reserve(2 * (expected > 0 ? expected : 1), &granted);
+            used = 0;
+        }
+        out[used++] = from;
+        out[used++] = to;
+        sink.include(from);
+        sink.include(to);
+    }
+
+    // what the sink still has room for, not counting what was written but not committed yet
+    size_t room() const {
+        const size_t room = sink.room();
+        return room > used ? room - used : 0;
+    }
+
+private:
+    StampSink &sink;
+    st_inkData *out = nullptr;
+    size_t granted = 0;
+    size_t used = 0;
+};
+
+void StrokeBuilder::addPoint(const st_inputPoint &point, StampSink &stamps) {
+    if (!inStroke) {
+        if (point.pressure == 0) {
+            return;
+        }
+        beginStroke(point, stamps);
+        return;
+    }
+
+    if (point.pressure == 0) {
+        // with stamps a good part of their size apart, the last one can fall well short of the last sample
+        const st_inputPoint &last = recent[historySize - 1];
+        if (!capsules && leftoverSpacing > REDUNDANT_DISTANCE) {
+            StampWriter writer(stamps);
+            writer.add({last.x, last.y, last.pressure}, 1);
+            current.stamps++;
+            strokeTotals.stamps++;
+        }
+        current.endTime = point.time;
+        endStroke();
+        return;
+    }
+
+    if (isRedundant(point)) {
+        current.redundant++;
+        strokeTotals.redundant++;
+        return;
+    }
+
+    const st_inputPoint &prev = recent[historySize - 1];
+    const float dx = point.x - prev.x;
+    const float dy = point.y - prev.y;
+    const float dist = module(dx, dy);
+    const DWORD dt = point.time - prev.time;
+
+    // Hermite tangents, scaled to the segment duration. The tangent at prev blends the velocities
+    // into and out of it weighted by time; the end tangent is the segment's own velocity since the
+    // next sample isn't known yet. Without usable timestamps the segment stays straight.
+    float startTangentX = dx, startTangentY = dy;
+    float endTangentX = dx, endTangentY = dy;
+    float chordVelocityX = 0, chordVelocityY = 0;
+    if (dt > 0) {
+        chordVelocityX = dx / (float) dt;
+        chordVelocityY = dy / (float) dt;
+        if (historyCount >= 2) {
+            const DWORD prevDt = prev.time - recent[historySize - 2].time;
+            if (prevDt > 0) {
+                const float total = (float) (prevDt + dt);
+                const float prevVelocityX = (velocityX * (float) dt + chordVelocityX * (float) prevDt) / total;
+                const float prevVelocityY = (velocityY * (float) dt + chordVelocityY * (float) prevDt) / total;
+                startTangentX = prevVelocityX * (float) dt;
+                startTangentY = prevVelocityY * (float) dt;
+            }
+        }
+
+        const float speed = module(chordVelocityX, chordVelocityY);
+        if (speed > current.maxSpeed) {
+            current.maxSpeed = speed;
+        }
+    }
+
+    pending.from = prev;
+    pending.to = point;
+    pending.startTangentX = startTangentX;
+    pending.startTangentY = startTangentY;
+    pending.endTangentX = endTangentX;
+    pending.endTangentY = endTangentY;
+    pending.next = 0;
+    if (capsules) {
+        // the curve strays at most 4/27 of the tangents' difference from the chord, and a quarter of
+        // that each time the pieces double
+        const float deviation = 4.0f / 27 * (module(startTangentX - dx, startTangentY - dy) +
+                                             module(endTangentX - dx, endTangentY - dy));
+        int pieces = (int) std::ceil(std::sqrt(deviation / CAPSULE_TOLERANCE));
+        pieces = pieces < 1 ? 1 : pieces > CAPSULE_MAX_PIECES ? CAPSULE_MAX_PIECES : pieces;
+        pending.capsuleFrom = {prev.x, prev.y, prev.pressure};
+        pending.count = pieces;
+    } else {
+        // Stamps land every stampSpacing pixels of chord, counting on from where the last segment left off.
+        // Samples are close enough that the spacing can follow the pressure one segment at a time.
+        const float stampSpacing = spacing.at((prev.pressure + point.pressure) / 2);
+        const float progress = leftoverSpacing + dist / stampSpacing;
+        pending.count = (size_t) progress;
+        pending.firstT = (1 - leftoverSpacing) * stampSpacing / dist;
+        pending.stepT = stampSpacing / dist;
+        leftoverSpacing = progress - (float) pending.count;
+    }
+    catchUp(stamps);
+
+    current.samples++;
+    strokeTotals.samples++;
+    current.length += dist;
+    current.endTime = point.time;
+
+    velocityX = chordVelocityX;
+    velocityY = chordVelocityY;
+    remember(point);
+}
+
+void StrokeBuilder::catchUp(StampSink &stamps) {
+    if (!behind()) {
+        return;
+    }
+
+    const st_stampCurve curve = makeStampCurve(pending.from, pending.to, pending.startTangentX,
+                                               pending.startTangentY, pending.endTangentX, pending.endTangentY);
+    const size_t before = pending.next;
+    if (capsules) {
+        StampWriter writer(stamps);
+        // with a single stamp of room left the last capsule still goes in whole
+        while (pending.next < pending.count && writer.room() > 0) {
+            pending.next++;
+            const st_inkData to = stampAt(curve, (float) pending.next / (float) pending.count);
+            writer.addCapsule(pending.capsuleFrom, to, pending.count - pending.next + 1);
+            pending.capsuleFrom = to;
+        }
+    } else {
+        while (pending.next < pending.count && stamps.room() > 0) {
+            size_t granted;
+            st_inkData *out = stamps.reserve(pending.count - pending.next, &granted);
+            stamps.include(generateStamps(curve, pending.firstT + (float) pending.next * pending.stepT,
+                                          pending.stepT, granted, out));
+            stamps.commit(granted);
+            pending.next += granted;
+        }
+    }
+
+    const size_t added = pending.next - before;
+    current.stamps += (int) added;
+    strokeTotals.stamps += (long long) added;
+}
+
+void StrokeBuilder::beginStroke(const st_inputPoint &point, StampSink &stamps) {
+    StampWriter writer(stamps);
+    if (capsules) {
+        // a dot, so a stroke that never moves still shows up
+        writer.addCapsule({point.x, point.y, point.pressure}, {point.x, point.y, point.pressure}, 1);
+    } else {
+        writer.add({point.x, point.y, point.pressure}, 1);
+    }
+
+    inStroke = true;
+    leftoverSpacing = 0;
+    historyCount = 0;
+    velocityX = 0;
+    velocityY = 0;
+    remember(point);
+
+    current = {};
+    current.startTime = point.time;
+    current.endTime = point.time;
+    current.samples = 1;
+    current.stamps = 1;
+    strokeTotals.strokes++;
+    strokeTotals.samples++;
+    strokeTotals.stamps++;
+}
+
+void StrokeBuilder::endStroke() {
+    inStroke = false;
+    strokeTotals.drawingTime += current.endTime - current.startTime;
+    strokeTotals.length += current.length;
+    strokeTotals.maxSpeed = std::max(strokeTotals.maxSpeed, current.maxSpeed);
+}
+
+bool StrokeBuilder::isRedundant(const st_inputPoint &point) const {
+    const st_inputPoint &prev = recent[historySize - 1];
+    return point.pressure == prev.pressure &&
+           module(point.x - prev.x, point.y - prev.y) < spacing.at(prev.pressure) * REDUNDANT_DISTANCE;
+}
+
+void StrokeBuilder::remember(const st_inputPoint &point) {
+    for (int i = 0; i < historySize - 1; ++i) {
+        recent[i] = recent[i + 1];
+    }
+    recent[historySize - 1] = point;
+    if (historyCount < historySize) {
+        historyCount++;
+    }
+}
+
+void StrokePredictor::predict(const StrokeBuilder &builder, float ahead, StampSink &stamps) const {
+    int count;
+    const st_inputPoint *history = builder.history(&count);
+    if (!builder.stroking() || count < 2 || ahead <= 0) {
+        return;
+    }
+    if (ahead > PREDICTION_MAX_AHEAD) {
+        ahead = PREDICTION_MAX_AHEAD;
+    }
+
+    const st_inputPoint &last = history[count - 1];
+    const st_inputPoint &before = history[count - 2];
+    const DWORD dt = last.time - before.time;
+    if (dt == 0) {
+        return;
+    }
+
+    // constant acceleration model over the last three samples, pressure follows its last trend
+    const float velocityX = (last.x - before.x) / (float) dt;
+    const float velocityY = (last.y - before.y) / (float) dt;
+    const float pressureRate = (last.pressure - before.pressure) / (float) dt;
+    float accelerationX = 0, accelerationY = 0;
+    if (count >= 3) {
+        const st_inputPoint &first = history[count - 3];
+        const DWORD prevDt = before.time - first.time;
+        if (prevDt > 0) {
+            const float midDt = (float) (prevDt + dt) / 2;
+            accelerationX = PREDICTION_ACCELERATION * (velocityX - (before.x - first.x) / (float) prevDt) / midDt;
+            accelerationY = PREDICTION_ACCELERATION * (velocityY - (before.y - first.y) / (float) prevDt) / midDt;
+        }
+    }
+    const float maxPressure = last.pressure > before.pressure ? last.pressure : before.pressure;
+
+    StampWriter writer(stamps);
+    st_inkData from = {last.x, last.y, last.pressure};
+    float leftoverSpacing = 0;
+    for (int step = 1; step <= PREDICTION_STEPS; ++step) {
+        const float t = ahead * (float) step / PREDICTION_STEPS;
+        // stop where the model turns back on itself, past that point it is only guessing the noise
+        if ((velocityX + accelerationX * t) * velocityX + (velocityY + accelerationY * t) * velocityY < 0) {
+            break;
+        }
+        float toPressure = last.pressure + pressureRate * t;
+        if (toPressure <= 0) {
+            // the pen is about to lift
+            break;
+        }
+        if (toPressure > maxPressure) {
+            toPressure = maxPressure;
+        }
+        const st_inkData to = {
+                last.x + velocityX * t + accelerationX * t * t / 2,
+                last.y + velocityY * t + accelerationY * t * t / 2,
+                toPressure
+        };
+
+        if (capsules) {
+            writer.addCapsule(from, to, PREDICTION_STEPS - step + 1);
+            from = to;
+            continue;
+        }
+
+        const float dist = module(to.x - from.x, to.y - from.y);
+        const float stampSpacing = spacing.at((from.size + to.size) / 2);
+        const float stampsInStep = leftoverSpacing + dist / stampSpacing;
+        float stampCount = 1;
+        while (stampCount <= stampsInStep) {
+            const float scaling = (stampCount - leftoverSpacing) * stampSpacing / dist;
+            st_inkData fillerInk = {
+                    from.x + (to.x - from.x) * scaling,
+                    from.y + (to.y - from.y) * scaling,
+                    from.size + (to.size - from.size) * scaling
+            };
+            writer.add(fillerInk, (size_t) (stampsInStep - stampCount) + 1);
+
+            stampCount++;
+        }
+        leftoverSpacing = stampsInStep - (stampCount - 1);
+        from = to;
+    }
+}
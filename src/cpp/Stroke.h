@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Packet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+
+// A stamp in canvas coordinates. size carries the raw pen pressure, the shader turns it into a diameter.
+struct st_inkData {
+    float x;
+    float y;
+    float size;
+};
+
+// Box around the centers of a group of stamps, in canvas coordinates, and the largest size among them.
+struct st_stampBounds {
+    float minX, minY;
+    float maxX, maxY;
+    float maxSize;
+};
+
+// How far apart stamps are: a fraction of their diameter, which follows pressure the same way vertex.glsl
+// sizes the quad, so big stamps don't pile up on each other.
+struct st_stampSpacing {
+    float minSize;  // diameter at no pressure, canvas pixels
+    float maxSize;  // diameter at maxPressure
+    float maxPressure;
+    float fraction;
+
+    // canvas pixels between two stamps of this pressure
+    float at(float pressure) const {
+        return fraction * (minSize + pressure * (maxSize - minSize) / maxPressure);
+    }
+};
+
+// Where generated stamps go. It hands out contiguous room so stamps can be written straight into the
+// memory they are drawn from, which may be write-only, so writers also report each stamp to include().
+// A sink can be limited to a number of stamps; writers check room() and stop when it runs out.
+class StampSink {
+public:
+    virtual ~StampSink() = default;
+
+    // Room for up to count stamps, at least one. *granted is set to how many fit, never more than room()
+    // unless that is less than the two stamps of a capsule.
+    virtual st_inkData *reserve(size_t count, size_t *granted) = 0;
+
+    // The first used stamps of the last reservation were written.
+    virtual void commit(size_t used) = 0;
+
+    // Stamps that may still be written before the limit is reached.
+    size_t room() const {
+        return stampRoom;
+    }
+
+    // From now on, no more than stamps stamps may be written.
+    void limit(size_t stamps) {
+        stampRoom = stamps;
+    }
+
+    void include(const st_inkData &stamp) {
+        stampBounds.minX = std::min(stampBounds.minX, stamp.x);
+        stampBounds.minY = std::min(stampBounds.minY, stamp.y);
+        stampBounds.maxX = std::max(stampBounds.maxX, stamp.x);
+        stampBounds.maxY = std::max(stampBounds.maxY, stamp.y);
+        stampBounds.maxSize = std::max(stampBounds.maxSize, stamp.size);
+    }
+
+    void include(const st_stampBounds &bounds) {
+        stampBounds.minX = std::min(stampBounds.minX, bounds.minX);
+        stampBounds.minY = std::min(stampBounds.minY, bounds.minY);
+        stampBounds.maxX = std::max(stampBounds.maxX, bounds.maxX);
+        stampBounds.maxY = std::max(stampBounds.maxY, bounds.maxY);
+        stampBounds.maxSize = std::max(stampBounds.maxSize, bounds.maxSize);
+    }
+
+    // Bounds of the stamps included since the last resetBounds().
+    const st_stampBounds &bounds() const {
+        return stampBounds;
+    }
+
+    void resetBounds() {
+        stampBounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0};
+    }
+
+protected:
+    // How many stamps reserve() may grant for a request of count.
+    size_t grantable(size_t count) const {
+        const size_t most = stampRoom < 2 ? 2 : stampRoom;
+        return count < most ? count : most;
+    }
+
+    // Takes used stamps off room(), called by commit().
+    void charge(size_t used) {
+        stampRoom = used < stampRoom ? stampRoom - used : 0;
+    }
+
+private:
+    st_stampBounds stampBounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0};
+    size_t stampRoom = SIZE_MAX;
+};
+
+// One pen sample in canvas coordinates, still carrying the packet timestamp.
+struct st_inputPoint {
+    float x;
+    float y;
+    float pressure;
+    DWORD time;  // pkTime, milliseconds
+};
+
+// Timing and shape of a single stroke.
+struct st_strokeInfo {
+    DWORD startTime;
+    DWORD endTime;
+    int samples;      // pen samples that produced stamps
+    int redundant;    // samples dropped because they added nothing
+    int stamps;       // or capsules
+    float length;     // canvas pixels
+    float maxSpeed;   // canvas pixels per millisecond
+};
+
+// The rest of a segment that didn't fit in the sink, as the curve it follows and how far along it got.
+struct st_pendingSegment {
+    st_inputPoint from;
+    st_inputPoint to;
+    float startTangentX, startTangentY;
+    float endTangentX, endTangentY;
+    float firstT;  // t of the first stamp
+    float stepT;   // t between stamps
+    st_inkData capsuleFrom;  // start of the next capsule
+    size_t next;   // stamps, or capsules, written so far
+    size_t count;  // stamps, or capsules, in the whole segment
+};
+
+// Running totals over every stroke so far.
+struct st_strokeTotals {
+    int strokes;
+    long long samples;
+    long long redundant;
+    long long stamps;  // or capsules
+    // of the finished strokes
+    long long drawingTime;  // milliseconds
+    double length;          // canvas pixels
+    float maxSpeed;         // canvas pixels per millisecond
+};
+
+// Turns pen samples into stamps spaced along the stroke, closer together where the pen presses lighter.
+// Between two samples the path follows a cubic Hermite curve whose tangents come from the pen
+// velocity (distance over pkTime), so fast, sparsely sampled strokes bend smoothly instead of
+// turning into polylines.
+// With capsules, each sample instead adds one capsule from the previous sample, or a few where the curve
+// bends, written as two stamps in a row: its start and its end. The shader covers it as if it were
+// densely stamped.
+class StrokeBuilder {
+public:
+    explicit StrokeBuilder(const st_stampSpacing &spacing, bool capsules = false)
+            : spacing(spacing), capsules(capsules) {}
+
+    // Feeds one sample. A pressure of 0 ends the current stroke.
+    // Stamps for the new part of the stroke go to stamps, as many as it has room for. Whatever doesn't fit
+    // is left for catchUp(), and no sample may be fed while behind().
+    void addPoint(const st_inputPoint &point, StampSink &stamps);
+
+    // Goes on with the part of the newest segment that didn't fit, as far as stamps has room.
+    void catchUp(StampSink &stamps);
+
+    // True while part of the newest segment hasn't been written yet.
+    bool behind() const {
+        return pending.next < pending.count;
+    }
+
+    bool stroking() const {
+        return inStroke;
+    }
+
+    const st_strokeTotals &totals() const {
+        return strokeTotals;
+    }
+
+    // Most recent samples of the current stroke, newest last. At most historySize of them.
+    const st_inputPoint *history(int *count) const {
+        *count = historyCount;
+        return recent + (historySize - historyCount);
+    }
+
+    static const int historySize = 4;
+
+private:
+    void beginStroke(const st_inputPoint &point, StampSink &stamps);
+
+    void endStroke();
+
+    bool isRedundant(const st_inputPoint &point) const;
+
+    void remember(const st_inputPoint &point);
+
+    st_stampSpacing spacing;
+    bool capsules;
+    bool inStroke = false;
+    // distance covered since the last stamp, as a fraction of the spacing
+    float leftoverSpacing = 0;
+
+    // recent[historySize - 1] is the newest sample
+    st_inputPoint recent[historySize] = {};
+    int historyCount = 0;
+    // velocity of the segment ending at the newest sample, canvas pixels per millisecond
+    float velocityX = 0;
+    float velocityY = 0;
+
+    st_pendingSegment pending = {};
+
+    st_strokeInfo current = {};  // added to the totals when it ends
+    st_strokeTotals strokeTotals = {};
+};
+
+// Guesses where the pen is going from the last few samples of the current stroke, so the tip of the
+// stroke can be drawn before its packets arrive. The guess is meant to be drawn on top of the ink
+// layer for one frame and thrown away once real samples cover it.
+class StrokePredictor {
+public:
+    // capsules as in StrokeBuilder
+    explicit StrokePredictor(const st_stampSpacing &spacing, bool capsules = false)
+            : spacing(spacing), capsules(capsules) {}
+
+    // Writes stamps for the next ahead milliseconds of the stroke, continuing from its newest sample.
+    // Writes nothing when no stroke is in progress or there isn't enough history to estimate velocity.
+    void predict(const StrokeBuilder &builder, float ahead, StampSink &stamps) const;
+
+private:
+    st_stampSpacing spacing;
+    bool capsules;
+};
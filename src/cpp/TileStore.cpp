@@ -0,0 +1,273 @@
+#include "TileStore.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#define TILE_FILE_EXTENSION ".tile"
+// the store's own directory is named after this and the time it was opened
+#define TILE_SESSION_PREFIX "session-"
+#define TILE_SESSION_ATTEMPTS 100
+// longest run or literal stretch one PackBits header covers
+#define PACKBITS_MAX 128
+
+// PackBits: a header n below 128 is followed by n + 1 bytes as they are, one above it by a single byte
+// repeated 257 - n times.
+static void packBits(const std::vector<unsigned char> &raw, std::vector<unsigned char> &packed) {
+    packed.clear();
+    size_t i = 0;
+    while (i < raw.size()) {
+        size_t run = 1;
+        while (i + run < raw.size() && run < PACKBITS_MAX && raw[i + run] == raw[i]) {
+            run++;
+        }
+        if (run >= 3) {
+            packed.push_back((unsigned char) (257 - run));
+            packed.push_back(raw[i]);
+            i += run;
+            continue;
+        }
+
+        // bytes as they are, up to where a run worth packing starts
+        size_t literal = 0;
+        while (i + literal < raw.size() && literal < PACKBITS_MAX &&
+               !(i + literal + 2 < raw.size() && raw[i + literal] == raw[i + literal + 1] &&
+                 raw[i + literal] == raw[i + literal + 2])) {
+            literal++;
+        }
+        packed.push_back((unsigned char) (literal - 1));
+        packed.insert(packed.end(), raw.begin() + (long) i, raw.begin() + (long) (i + literal));
+        i += literal;
+    }
+}
+
+static bool unpackBits(const std::vector<unsigned char> &packed, size_t size, std::vector<unsigned char> &raw) {
+    raw.clear();
+    raw.reserve(size);
+    size_t i = 0;
+    while (i < packed.size()) {
+        const unsigned char header = packed[i++];
+        if (header < 128) {
+            const size_t literal = header + 1;
+            if (i + literal > packed.size() || raw.size() + literal > size) {
+                return false;
+            }
+            raw.insert(raw.end(), packed.begin() + (long) i, packed.begin() + (long) (i + literal));
+            i += literal;
+        } else if (header > 128) {
+            const size_t run = 257 - header;
+            if (i >= packed.size() || raw.size() + run > size) {
+                return false;
+            }
+            raw.insert(raw.end(), run, packed[i++]);
+        }
+    }
+    return raw.size() == size;
+}
+
+TileStore::~TileStore() {
+    close();
+}
+
+bool TileStore::open(const char *storeDirectory, size_t bytes, void (*notifyLoaded)()) {
+    tileBytes = bytes;
+    notify = notifyLoaded;
+    std::error_code error;
+    std::filesystem::create_directories(storeDirectory, error);
+    if (!std::filesystem::is_directory(storeDirectory, error)) {
+        std::cout << "Can't use " << storeDirectory << " for ink tiles" << std::endl;
+        return false;
+    }
+
+    // another instance may have opened a store in the same millisecond
+    const auto opened = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    directory.clear();
+    for (int attempt = 0; attempt < TILE_SESSION_ATTEMPTS && directory.empty(); ++attempt) {
+        const std::filesystem::path session = std::filesystem::path(storeDirectory) /
+                (TILE_SESSION_PREFIX + std::to_string(opened) + (attempt > 0 ? "-" + std::to_string(attempt) : ""));
+        if (std::filesystem::create_directory(session, error)) {
+            directory = session.string();
+        } else if (error) {
+            break;
+        }
+    }
+    if (directory.empty()) {
+        std::cout << "Can't create a directory for ink tiles in " << storeDirectory << std::endl;
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&TileStore::run, this);
+    return true;
+}
+
+void TileStore::close() {
+    {
+        // the files are deleted right after, so only the job the thread is on gets finished
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.clear();
+        pending.clear();
+        running = false;
+    }
+    wakeup.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (!directory.empty()) {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+        directory.clear();
+    }
+}
+
+void TileStore::write(int x, int y, std::vector<unsigned char> &&texels) {
+    const uint64_t version = ++writeVersion;
+    stored[tileKey(x, y)] = version;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending[tileKey(x, y)] = {std::move(texels), version};
+        jobs.push_back({STORE_WRITE, x, y, version});
+    }
+    wakeup.notify_one();
+}
+
+void TileStore::request(int x, int y) {
+    const auto found = stored.find(tileKey(x, y));
+    if (found == stored.end()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({STORE_READ, x, y, found->second});
+    }
+    wakeup.notify_one();
+}
+
+void TileStore::takeLoaded(std::vector<st_storedTile> &tiles) {
+    tiles.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        // written again since it was asked for, or cleared
+        const auto found = stored.find(tileKey(loaded[i].x, loaded[i].y));
+        if (found != stored.end() && found->second == loadedVersions[i]) {
+            tiles.push_back(std::move(loaded[i]));
+        }
+    }
+    loaded.clear();
+    loadedVersions.clear();
+}
+
+void TileStore::clear() {
+    stored.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        // writes not started yet would only be deleted again
+        std::erase_if(jobs, [](const st_storeJob &job) { return job.kind == STORE_WRITE; });
+        jobs.push_back({STORE_CLEAR, 0, 0, 0});
+    }
+    wakeup.notify_one();
+}
+
+st_tileStoreStats TileStore::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return storeStats;
+}
+
+std::string TileStore::path(int x, int y) const {
+    return directory + "/" + std::to_string(x) + "_" + std::to_string(y) + TILE_FILE_EXTENSION;
+}
+
+bool TileStore::readFile(int x, int y, std::vector<unsigned char> &texels) const {
+    std::ifstream file(path(x, y), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    const std::vector<unsigned char> packed((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!unpackBits(packed, tileBytes, texels)) {
+        std::cout << "Ink tile " << x << ", " << y << " is damaged" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void TileStore::removeFiles() const {
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.path().extension() == TILE_FILE_EXTENSION) {
+            std::filesystem::remove(entry.path(), error);
+        }
+    }
+}
+
+void TileStore::run() {
+    std::vector<unsigned char> texels;
+    std::vector<unsigned char> packed;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeup.wait(lock, [this] { return !jobs.empty() || !running; });
+        if (jobs.empty()) {
+            break;
+        }
+        const st_storeJob job = jobs.front();
+        jobs.pop_front();
+        const uint64_t key = tileKey(job.x, job.y);
+
+        if (job.kind == STORE_WRITE) {
+            const auto waiting = pending.find(key);
+            if (waiting == pending.end()) {
+                continue;
+            }
+            texels = waiting->second.texels;
+            const uint64_t version = waiting->second.version;
+            lock.unlock();
+
+            packBits(texels, packed);
+            std::ofstream file(path(job.x, job.y), std::ios::binary | std::ios::trunc);
+            file.write((const char *) packed.data(), (std::streamsize) packed.size());
+            file.close();
+            if (!file) {
+                std::cout << "Failed to write ink tile " << job.x << ", " << job.y << std::endl;
+            }
+
+            lock.lock();
+            // a newer write of the tile is queued behind this one and stays pending until it's done
+            const auto written = pending.find(key);
+            if (file && written != pending.end() && written->second.version == version) {
+                pending.erase(written);
+            }
+            storeStats.written++;
+            storeStats.rawBytes += texels.size();
+            storeStats.storedBytes += packed.size();
+        } else if (job.kind == STORE_READ) {
+            const auto waiting = pending.find(key);
+            bool found = waiting != pending.end();
+            if (found) {
+                texels = waiting->second.texels;
+            } else {
+                lock.unlock();
+                found = readFile(job.x, job.y, texels);
+                lock.lock();
+            }
+            if (found) {
+                loaded.push_back({job.x, job.y, texels});
+                storeStats.read++;
+            } else {
+                loaded.push_back({job.x, job.y, {}});
+            }
+            loadedVersions.push_back(job.version);
+            if (notify) {
+                lock.unlock();
+                notify();
+                lock.lock();
+            }
+        } else {
+            lock.unlock();
+            removeFiles();
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Key of tile (x, y), tile coordinates being any int.
+inline uint64_t tileKey(int x, int y) {
+    return (uint64_t) (uint32_t) x << 32 | (uint32_t) y;
+}
+
+// A tile read back from disk.
+struct st_storedTile {
+    int x, y;
+    std::vector<unsigned char> texels;
+};
+
+// Counters of the store thread. Safe to read from any thread.
+struct st_tileStoreStats {
+    uint64_t written;       // tiles
+    uint64_t read;          // tiles, asked for or not
+    uint64_t rawBytes;      // of the tiles written
+    uint64_t storedBytes;   // the same tiles compressed
+};
+
+// Ink tiles kept on disk, one file per tile, compressed with PackBits runs since coverage is mostly long
+// stretches of empty or solid ink. Files are written and read on the store's own thread: write() and
+// request() only queue the work and return, and tiles that were asked for are picked up with takeLoaded().
+// Work is done in the order it was queued, and a tile that is still waiting to be written is served from
+// memory, so reads always see the last write. Every write gives the tile a new version; a read is tagged with
+// the version it asked for and dropped if the tile was written again or cleared before it was taken.
+// notify, if given, is called from the store thread whenever a tile it was asked for is ready.
+// Everything but the thread itself is for the thread that opened the store.
+class TileStore {
+public:
+    ~TileStore();
+
+    // Keeps tiles of tileBytes each in a new directory of the store's own under directory, which is created
+    // if needed. Nothing else under directory is touched.
+    bool open(const char *directory, size_t tileBytes, void (*notify)() = nullptr);
+
+    // Drops the queued work, stops the thread and deletes the store's directory, the ink its tiles belonged
+    // to is gone with the session.
+    void close();
+
+    // The tile was written, whether or not it has reached the disk yet.
+    bool has(int x, int y) const {
+        return stored.count(tileKey(x, y)) > 0;
+    }
+
+    void write(int x, int y, std::vector<unsigned char> &&texels);
+
+    // Queues reading the tile back, it shows up in takeLoaded() once read.
+    void request(int x, int y);
+
+    // Moves out the tiles read back since the last call. A tile whose file couldn't be read comes back
+    // without texels, so whoever asked for it doesn't wait forever.
+    void takeLoaded(std::vector<st_storedTile> &loaded);
+
+    // Forgets every tile and deletes their files.
+    void clear();
+
+    st_tileStoreStats stats();
+
+private:
+    enum e_storeJob {
+        STORE_WRITE,
+        STORE_READ,
+        STORE_CLEAR,
+    };
+
+    struct st_storeJob {
+        e_storeJob kind;
+        int x, y;
+        uint64_t version;  // of the tile, the one written or the one asked for
+    };
+
+    // texels of a write, kept until they are on disk
+    struct st_pendingTile {
+        std::vector<unsigned char> texels;
+        uint64_t version;
+    };
+
+    void run();
+
+    std::string path(int x, int y) const;
+
+    bool readFile(int x, int y, std::vector<unsigned char> &texels) const;
+
+    void removeFiles() const;
+
+    std::string directory;
+    size_t tileBytes = 0;
+    void (*notify)() = nullptr;
+    // version of every tile written since the last clear, owner thread only
+    std::unordered_map<uint64_t, uint64_t> stored;
+    uint64_t writeVersion = 0;  // owner thread only
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool running = false;
+    std::deque<st_storeJob> jobs;
+    std::unordered_map<uint64_t, st_pendingTile> pending;
+    std::vector<st_storedTile> loaded;
+    std::vector<uint64_t> loadedVersions;  // one per loaded tile
+    st_tileStoreStats storeStats = {};
+};
@@ -15,6 +15,10 @@
 
 #include "Utils.h"
 
+#ifndef _WIN32
+#include "WintabEvdev.h"
+#endif
+
 HINSTANCE ghWintab = nullptr;
 
 WTINFOA gpWTInfoA = nullptr;
@@ -38,6 +42,7 @@ WTMGRCLOSE gpWTMgrClose = nullptr;
 WTMGRDEFCONTEXT gpWTMgrDefContext = nullptr;
 WTMGRDEFCONTEXTEX gpWTMgrDefContextEx = nullptr;
 
+#ifdef _WIN32
 // GETPROCADDRESS macro used to create the gpWT* () dynamic function pointers, which allow the
 // same built program to run on both 32bit and 64bit systems w/o having to rebuild the app.
 #define GETPROCADDRESS(type, func) \
@@ -85,6 +90,47 @@ bool LoadWintab() {
 
     return true;
 }
+#else
+// EVDEVPROC macro used to point the gpWT* () function pointers at the evdev backend.
+#define EVDEVPROC(func) \
+    gp##func = Evdev##func;
+
+// Purpose
+//		Find a pen tablet among the evdev devices and route the Wintab API to it.
+//
+//	Returns
+//		true on success.
+//		false if no tablet was found.
+//
+bool LoadWintab() {
+    if (!EvdevLoad()) {
+        return false;
+    }
+
+    EVDEVPROC(WTOpenA)
+    EVDEVPROC(WTInfoA)
+    EVDEVPROC(WTGetA)
+    EVDEVPROC(WTSetA)
+    EVDEVPROC(WTPacket)
+    EVDEVPROC(WTClose)
+    EVDEVPROC(WTEnable)
+    EVDEVPROC(WTOverlap)
+    EVDEVPROC(WTSave)
+    EVDEVPROC(WTConfig)
+    EVDEVPROC(WTRestore)
+    EVDEVPROC(WTExtSet)
+    EVDEVPROC(WTExtGet)
+    EVDEVPROC(WTQueueSizeSet)
+    EVDEVPROC(WTDataPeek)
+    EVDEVPROC(WTPacketsGet)
+    EVDEVPROC(WTMgrOpen)
+    EVDEVPROC(WTMgrClose)
+    EVDEVPROC(WTMgrDefContext)
+    EVDEVPROC(WTMgrDefContextEx)
+
+    return true;
+}
+#endif
 
 // Purpose
 //		Uninitializes use of wintab32.dll
@@ -94,10 +140,14 @@ bool LoadWintab() {
 //		Nothing.
 //
 void UnloadWintab() {
+#ifdef _WIN32
     if (ghWintab) {
         FreeLibrary(ghWintab);
         ghWintab = nullptr;
     }
+#else
+    EvdevUnload();
+#endif
 
     gpWTOpenA = nullptr;
     gpWTClose = nullptr;
@@ -14,13 +14,27 @@
 ---------------------------------------------------------------------------- */
 #pragma once
 
+#ifdef _WIN32
 #include    <windows.h>
+// WINTAB.H declares the ANSI context struct only under WIN32, which the compiler itself doesn't define.
+#ifndef WIN32
+#define WIN32
+#endif
+#else
+#include    "WinCompat.h"
+#endif
 #include    <cstdio>
 #include    <cassert>
 #include    <cstdarg>
 
 #include    <wacom-wintab/WINTAB.H>
 
+#ifndef _WIN32
+// WINTAB.H only declares the ANSI context struct on Windows; elsewhere it is plain LOGCONTEXT.
+typedef LOGCONTEXT LOGCONTEXTA;
+typedef LPLOGCONTEXT LPLOGCONTEXTA;
+#endif
+
 // Ignore warnings about using unsafe string functions.
 #pragma warning( disable : 4996 )
 
@@ -66,6 +80,7 @@ typedef HCTX ( API *WTMGRDEFCONTEXT )(HMGR, bool);
 typedef HCTX ( API *WTMGRDEFCONTEXTEX )(HMGR, UINT, bool);
 
 // Loaded Wintab32 API functions.
+// On Linux there is no Wintab32.dll; LoadWintab() points them at the evdev backend instead.
 extern HINSTANCE ghWintab;
 
 extern WTINFOA gpWTInfoA;
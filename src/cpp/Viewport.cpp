@@ -0,0 +1,79 @@
+#include "Viewport.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+void Viewport::attach(GLFWwindow *window) {
+    st_viewportGeometry current = view;
+    glfwGetWindowPos(window, &current.window_x, &current.window_y);
+    glfwGetWindowSize(window, &current.window_w, &current.window_h);
+    glfwGetFramebufferSize(window, &current.framebuffer_w, &current.framebuffer_h);
+    update(current);
+
+    glfwSetWindowUserPointer(window, this);
+    glfwSetWindowPosCallback(window, positionCallback);
+    glfwSetWindowSizeCallback(window, sizeCallback);
+    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+}
+
+void Viewport::positionCallback(GLFWwindow *window, int x, int y) {
+    auto *viewport = (Viewport *) glfwGetWindowUserPointer(window);
+    st_viewportGeometry current = viewport->view;
+    current.window_x = x;
+    current.window_y = y;
+    viewport->update(current);
+}
+
+void Viewport::sizeCallback(GLFWwindow *window, int width, int height) {
+    auto *viewport = (Viewport *) glfwGetWindowUserPointer(window);
+    st_viewportGeometry current = viewport->view;
+    current.window_w = width;
+    current.window_h = height;
+    viewport->update(current);
+}
+
+void Viewport::framebufferSizeCallback(GLFWwindow *window, int width, int height) {
+    auto *viewport = (Viewport *) glfwGetWindowUserPointer(window);
+    st_viewportGeometry current = viewport->view;
+    current.framebuffer_w = width;
+    current.framebuffer_h = height;
+    viewport->update(current);
+}
+
+void Viewport::update(const st_viewportGeometry &changed) {
+    st_viewportGeometry current = changed;
+
+    // minimized windows report a zero size, keep the last canvas until there is something to show
+    if (current.window_w > 0 && current.window_h > 0) {
+        const double windowAspectRatio = (double) current.window_w / current.window_h;
+        const double canvasAspectRatio = (double) canvasWidth / canvasHeight;
+
+        if (canvasAspectRatio < windowAspectRatio) {
+            current.canvas_w = current.window_h * canvasWidth / canvasHeight;
+            current.canvas_h = current.window_h;
+            current.canvas_x = (current.window_w - current.canvas_w) / 2;
+            current.canvas_y = 0;
+        } else {
+            current.canvas_w = current.window_w;
+            current.canvas_h = current.window_w * canvasHeight / canvasWidth;
+            current.canvas_x = 0;
+            current.canvas_y = (current.window_h - current.canvas_h) / 2;
+        }
+    }
+
+    if (viewGeneration > 0 &&
+        current.window_x == view.window_x && current.window_y == view.window_y &&
+        current.window_w == view.window_w && current.window_h == view.window_h &&
+        current.framebuffer_w == view.framebuffer_w && current.framebuffer_h == view.framebuffer_h &&
+        current.canvas_x == view.canvas_x && current.canvas_y == view.canvas_y &&
+        current.canvas_w == view.canvas_w && current.canvas_h == view.canvas_h) {
+        return;
+    }
+
+    view = current;
+    if (view.canvas_w > 0) {
+        transform = makeCanvasTransform(view.window_x + view.canvas_x, view.window_y + view.canvas_y, view.canvas_w,
+                                        canvasWidth);
+    }
+    viewGeneration++;
+}
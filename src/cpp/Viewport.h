@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CanvasTransform.h"
+
+#include <cstdint>
+
+struct GLFWwindow;
+
+// Window and canvas geometry. Positions and sizes are in screen coordinates except the framebuffer size,
+// which is in pixels and differs from the window size on high DPI screens.
+struct st_viewportGeometry {
+    int window_x, window_y, window_w, window_h;
+    int framebuffer_w, framebuffer_h;
+    // the canvas is centered in the window and keeps the aspect ratio of the background
+    int canvas_x, canvas_y, canvas_w, canvas_h;
+};
+
+// Keeps the window and canvas geometry up to date from GLFW callbacks, so nothing has to be queried or
+// recomputed per frame. generation() goes up on every real change; anything derived from the geometry
+// can remember the generation it was built for and rebuild only when it differs.
+class Viewport {
+public:
+    // canvasWidth and canvasHeight are the size of the canvas in canvas pixels
+    Viewport(int canvasWidth, int canvasHeight) : canvasWidth(canvasWidth), canvasHeight(canvasHeight) {}
+
+    // Reads the current geometry and installs position, size and framebuffer size callbacks.
+    // Uses the window user pointer.
+    void attach(GLFWwindow *window);
+
+    const st_viewportGeometry &geometry() const {
+        return view;
+    }
+
+    // From packet coordinates (screen pixels) to canvas pixels.
+    const st_canvasTransform &packetToCanvas() const {
+        return transform;
+    }
+
+    uint64_t generation() const {
+        return viewGeneration;
+    }
+
+private:
+    static void positionCallback(GLFWwindow *window, int x, int y);
+
+    static void sizeCallback(GLFWwindow *window, int width, int height);
+
+    static void framebufferSizeCallback(GLFWwindow *window, int width, int height);
+
+    void update(const st_viewportGeometry &changed);
+
+    int canvasWidth;
+    int canvasHeight;
+    st_viewportGeometry view = {};
+    st_canvasTransform transform = {};
+    uint64_t viewGeneration = 0;
+};
@@ -0,0 +1,132 @@
+// Creates a uinput pen tablet and draws a few strokes with it, so the evdev backend can be exercised
+// on machines without a real tablet. Start it, then start the app within the delay.
+//
+//     virtual_tablet [--rate HZ] [--strokes N] [--delay SECONDS]
+
+#include <linux/uinput.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+#define TABLET_MAX_X 32767
+#define TABLET_MAX_Y 18431
+#define TABLET_MAX_PRESSURE 4095
+#define TABLET_RESOLUTION 200  // units per mm
+
+static void emit(int fd, unsigned short type, unsigned short code, int value) {
+    input_event event = {};
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    if (write(fd, &event, sizeof(event)) != sizeof(event)) {
+        std::cout << "uinput write failed: " << std::strerror(errno) << std::endl;
+    }
+}
+
+static void setupAxis(int fd, unsigned short code, int maximum, int resolution) {
+    uinput_abs_setup abs = {};
+    abs.code = code;
+    abs.absinfo.minimum = 0;
+    abs.absinfo.maximum = maximum;
+    abs.absinfo.resolution = resolution;
+    ioctl(fd, UI_SET_ABSBIT, code);
+    ioctl(fd, UI_ABS_SETUP, &abs);
+}
+
+static void sleepUntil(timespec *deadline, long periodNs) {
+    deadline->tv_nsec += periodNs;
+    while (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_nsec -= 1000000000L;
+        deadline->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, nullptr);
+}
+
+int main(int argc, char **argv) {
+    int rate = 200;
+    int strokes = 5;
+    int delay = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--rate") == 0) {
+            rate = std::atoi(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--strokes") == 0) {
+            strokes = std::atoi(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--delay") == 0) {
+            delay = std::atoi(argv[i + 1]);
+        }
+    }
+    if (rate <= 0) {
+        rate = 200;
+    }
+
+    const int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        std::cout << "Failed to open /dev/uinput: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    ioctl(fd, UI_SET_KEYBIT, BTN_TOOL_PEN);
+    ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH);
+    ioctl(fd, UI_SET_KEYBIT, BTN_STYLUS);
+    setupAxis(fd, ABS_X, TABLET_MAX_X, TABLET_RESOLUTION);
+    setupAxis(fd, ABS_Y, TABLET_MAX_Y, TABLET_RESOLUTION);
+    setupAxis(fd, ABS_PRESSURE, TABLET_MAX_PRESSURE, 0);
+
+    uinput_setup setup = {};
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x1209;
+    setup.id.product = 0x0001;
+    std::strncpy(setup.name, "Blue Archive Notes virtual tablet", UINPUT_MAX_NAME_SIZE - 1);
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        std::cout << "Failed to create uinput device: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    std::cout << "Virtual tablet ready, drawing " << strokes << " strokes at " << rate << " Hz in " << delay << " s"
+              << std::endl;
+    sleep(delay);
+
+    const long periodNs = 1000000000L / rate;
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    for (int s = 0; s < strokes; ++s) {
+        // one second per stroke: a wave across the middle of the tablet with a pressure swell
+        const int samples = rate;
+        const double baseY = TABLET_MAX_Y * (0.2 + 0.6 * (s + 0.5) / strokes);
+
+        emit(fd, EV_KEY, BTN_TOOL_PEN, 1);
+        for (int i = 0; i <= samples; ++i) {
+            const double t = (double) i / samples;
+            emit(fd, EV_ABS, ABS_X, (int) (TABLET_MAX_X * (0.15 + 0.7 * t)));
+            emit(fd, EV_ABS, ABS_Y, (int) (baseY + TABLET_MAX_Y * 0.05 * std::sin(t * 4 * M_PI)));
+            emit(fd, EV_ABS, ABS_PRESSURE, (int) (TABLET_MAX_PRESSURE * (0.1 + 0.9 * std::sin(t * M_PI))));
+            if (i == 0) {
+                emit(fd, EV_KEY, BTN_TOUCH, 1);
+            }
+            emit(fd, EV_SYN, SYN_REPORT, 0);
+            sleepUntil(&deadline, periodNs);
+        }
+        emit(fd, EV_ABS, ABS_PRESSURE, 0);
+        emit(fd, EV_KEY, BTN_TOUCH, 0);
+        emit(fd, EV_KEY, BTN_TOOL_PEN, 0);
+        emit(fd, EV_SYN, SYN_REPORT, 0);
+        sleepUntil(&deadline, 200000000L);
+    }
+
+    // give readers a moment to drain before the device disappears
+    sleep(1);
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Just enough of the Win32 type vocabulary for WINTAB.H and PKTDEF.H to compile outside Windows.
+// Sizes follow the Windows LLP64 model (LONG and DWORD are 32 bits) so PACKET has the same layout
+// on every platform and recorded sessions can be replayed anywhere.
+
+#include <cstdint>
+#include <cwchar>
+
+typedef unsigned int UINT;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int BOOL;
+typedef uint16_t WORD;
+typedef uint8_t BYTE;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+
+typedef void *LPVOID;
+typedef int *LPINT;
+typedef BYTE *LPBYTE;
+typedef char *LPSTR;
+typedef wchar_t *LPWSTR;
+
+typedef void *HWND;
+typedef void *HINSTANCE;
+typedef intptr_t LPARAM;
+typedef uintptr_t WPARAM;
+typedef intptr_t LRESULT;
+
+#define DECLARE_HANDLE(name) struct name##__ { int unused; }; typedef struct name##__ *name
+
+#define WINAPI
+#define PASCAL
+#define NEAR
+#define FAR
+
+#define LOWORD(l) ((WORD) (((DWORD) (l)) & 0xffff))
+#define HIWORD(l) ((WORD) ((((DWORD) (l)) >> 16) & 0xffff))
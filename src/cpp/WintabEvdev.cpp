@@ -0,0 +1,461 @@
+#include "WintabEvdev.h"
+#include "Packet.h"
+
+#include <linux/input.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// input_events pulled from the kernel per read() call
+#define EVDEV_READ_BATCH 64
+// packets kept between WTPacketsGet calls until the app resizes the queue
+#define EVDEV_DEFAULT_QUEUE_SIZE 128
+// evdev has no notion of a report rate, so DVC_PKTRATE reports a typical pen rate
+#define EVDEV_NOMINAL_PKTRATE 200
+
+#define BITS_PER_LONG (8 * sizeof(long))
+#define NBITS(x) ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, array) (((array)[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+struct st_evdevDevice {
+    int fd = -1;
+    std::string path;
+    char name[256] = {};
+    bool direct = false;  // pen display rather than an opaque tablet
+    input_absinfo x = {};
+    input_absinfo y = {};
+    input_absinfo pressure = {};
+};
+
+struct st_evdevContext {
+    LOGCONTEXT lc;
+    std::deque<PACKET> queue;
+    size_t queueSize = EVDEV_DEFAULT_QUEUE_SIZE;
+
+    // pen state accumulated between SYN_REPORTs
+    int x = 0;
+    int y = 0;
+    int pressure = 0;
+    bool inProximity = false;
+    bool changed = false;
+    bool resyncing = false;  // the kernel dropped events, ignore everything up to the next SYN_REPORT
+};
+
+static st_evdevDevice gDevice;
+static st_evdevContext *gContext = nullptr;
+static int gScreenX = 0, gScreenY = 0, gScreenW = 0, gScreenH = 0;
+
+static bool probeTablet(int fd) {
+    unsigned long evBits[NBITS(EV_MAX + 1)] = {};
+    unsigned long absBits[NBITS(ABS_MAX + 1)] = {};
+    unsigned long keyBits[NBITS(KEY_MAX + 1)] = {};
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(evBits)), evBits) < 0 ||
+        ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) < 0 ||
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) < 0) {
+        return false;
+    }
+    return TEST_BIT(EV_ABS, evBits) && TEST_BIT(EV_KEY, evBits) &&
+           TEST_BIT(ABS_X, absBits) && TEST_BIT(ABS_Y, absBits) && TEST_BIT(ABS_PRESSURE, absBits) &&
+           TEST_BIT(BTN_TOOL_PEN, keyBits);
+}
+
+static bool openDevice(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (!probeTablet(fd)) {
+        close(fd);
+        return false;
+    }
+
+    gDevice.fd = fd;
+    gDevice.path = path;
+    ioctl(fd, EVIOCGNAME(sizeof(gDevice.name) - 1), gDevice.name);
+    ioctl(fd, EVIOCGABS(ABS_X), &gDevice.x);
+    ioctl(fd, EVIOCGABS(ABS_Y), &gDevice.y);
+    ioctl(fd, EVIOCGABS(ABS_PRESSURE), &gDevice.pressure);
+
+    unsigned long propBits[NBITS(INPUT_PROP_MAX + 1)] = {};
+    if (ioctl(fd, EVIOCGPROP(sizeof(propBits)), propBits) >= 0) {
+        gDevice.direct = TEST_BIT(INPUT_PROP_DIRECT, propBits);
+    }
+
+    // monotonic timestamps so pkTime never jumps with the wall clock
+    int clock = CLOCK_MONOTONIC;
+    ioctl(fd, EVIOCSCLOCKID, &clock);
+    return true;
+}
+
+bool EvdevLoad() {
+    if (gDevice.fd >= 0) {
+        return true;
+    }
+
+    const char *override = std::getenv("BAN_TABLET_DEVICE");
+    if (override) {
+        if (!openDevice(override)) {
+            std::cout << "Not a usable pen tablet: " << override << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    DIR *dir = opendir("/dev/input");
+    if (!dir) {
+        return false;
+    }
+    while (dirent *entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "event", 5) == 0 && openDevice(std::string("/dev/input/") + entry->d_name)) {
+            break;
+        }
+    }
+    closedir(dir);
+
+    if (gDevice.fd < 0) {
+        std::cout << "No pen tablet found in /dev/input (is the user in the input group?)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void EvdevUnload() {
+    delete gContext;
+    gContext = nullptr;
+    if (gDevice.fd >= 0) {
+        close(gDevice.fd);
+    }
+    gDevice = st_evdevDevice();
+}
+
+void EvdevSetScreenArea(int x, int y, int width, int height) {
+    gScreenX = x;
+    gScreenY = y;
+    gScreenW = width;
+    gScreenH = height;
+}
+
+static AXIS toAxis(const input_absinfo &abs, bool spatial) {
+    AXIS axis = {0};
+    axis.axMin = abs.minimum;
+    axis.axMax = abs.maximum;
+    if (spatial && abs.resolution > 0) {
+        // evdev resolution is units per millimetre
+        axis.axUnits = TU_CENTIMETERS;
+        axis.axResolution = CASTFIX32(abs.resolution * 10);
+    } else {
+        axis.axUnits = TU_NONE;
+    }
+    return axis;
+}
+
+// Wintab scaling from the input to the output extent. A negative output extent flips the axis.
+static LONG scaleAxis(LONG value, LONG inOrg, LONG inExt, LONG outOrg, LONG outExt) {
+    const long long offset = value - inOrg;
+    if (outExt >= 0) {
+        return (LONG) (outOrg + offset * outExt / inExt);
+    }
+    return (LONG) (outOrg + (inExt - 1 - offset) * -outExt / inExt);
+}
+
+UINT API EvdevWTInfoA(UINT category, UINT index, LPVOID output) {
+    if (gDevice.fd < 0 || !output) {
+        return 0;
+    }
+
+    if ((category == WTI_DEFSYSCTX || category == WTI_DEFCONTEXT) && index == 0) {
+        LOGCONTEXT lc = {0};
+        std::strncpy(lc.lcName, "evdev", LCNAMELEN - 1);
+        lc.lcOptions = category == WTI_DEFSYSCTX ? CXO_SYSTEM : 0;
+        lc.lcPktRate = EVDEV_NOMINAL_PKTRATE;
+        lc.lcPktData = PACKETDATA;
+        lc.lcPktMode = PACKETMODE;
+        lc.lcMoveMask = PACKETDATA;
+        lc.lcInOrgX = gDevice.x.minimum;
+        lc.lcInOrgY = gDevice.y.minimum;
+        lc.lcInExtX = gDevice.x.maximum - gDevice.x.minimum + 1;
+        lc.lcInExtY = gDevice.y.maximum - gDevice.y.minimum + 1;
+        if (gScreenW > 0 && gScreenH > 0) {
+            lc.lcOutOrgX = gScreenX;
+            lc.lcOutOrgY = gScreenY;
+            lc.lcOutExtX = gScreenW;
+            lc.lcOutExtY = gScreenH;
+        } else {
+            lc.lcOutExtX = lc.lcInExtX;
+            lc.lcOutExtY = lc.lcInExtY;
+        }
+        std::memcpy(output, &lc, sizeof(lc));
+        return sizeof(lc);
+    }
+
+    if (category != WTI_DEVICES) {
+        return 0;
+    }
+
+    switch (index) {
+        case DVC_NAME: {
+            const size_t length = std::strlen(gDevice.name) + 1;
+            std::memcpy(output, gDevice.name, length);
+            return (UINT) length;
+        }
+        case DVC_HARDWARE: {
+            const UINT hardware = HWC_HARDPROX | (gDevice.direct ? HWC_INTEGRATED : 0);
+            std::memcpy(output, &hardware, sizeof(hardware));
+            return sizeof(hardware);
+        }
+        case DVC_PKTRATE: {
+            const UINT rate = EVDEV_NOMINAL_PKTRATE;
+            std::memcpy(output, &rate, sizeof(rate));
+            return sizeof(rate);
+        }
+        case DVC_X:
+        case DVC_Y:
+        case DVC_NPRESSURE: {
+            const AXIS axis = index == DVC_X ? toAxis(gDevice.x, true) :
+                              index == DVC_Y ? toAxis(gDevice.y, true) :
+                              toAxis(gDevice.pressure, false);
+            std::memcpy(output, &axis, sizeof(axis));
+            return sizeof(axis);
+        }
+        default:
+            return 0;
+    }
+}
+
+HCTX API EvdevWTOpenA(HWND hwnd, LPLOGCONTEXTA logContext, bool enable) {
+    if (gDevice.fd < 0 || gContext) {
+        return nullptr;
+    }
+
+    gContext = new st_evdevContext();
+    gContext->lc = *logContext;
+
+    // throw away whatever happened before the context existed
+    input_event stale[EVDEV_READ_BATCH];
+    while (read(gDevice.fd, stale, sizeof(stale)) > 0) {}
+
+    return (HCTX) gContext;
+}
+
+bool API EvdevWTGetA(HCTX hctx, LPLOGCONTEXT logContext) {
+    if (!hctx || (st_evdevContext *) hctx != gContext) {
+        return false;
+    }
+    *logContext = gContext->lc;
+    return true;
+}
+
+bool API EvdevWTSetA(HCTX hctx, LPLOGCONTEXT logContext) {
+    if (!hctx || (st_evdevContext *) hctx != gContext) {
+        return false;
+    }
+    gContext->lc = *logContext;
+    return true;
+}
+
+bool API EvdevWTClose(HCTX hctx) {
+    if (!hctx || (st_evdevContext *) hctx != gContext) {
+        return false;
+    }
+    delete gContext;
+    gContext = nullptr;
+    return true;
+}
+
+static void emitPacket(st_evdevContext *ctx, const timeval &time) {
+    if (ctx->queue.size() >= ctx->queueSize) {
+        // like Wintab, a full queue discards new packets
+        return;
+    }
+
+    const LOGCONTEXT &lc = ctx->lc;
+    // evdev Y grows downwards while Wintab's grows upwards, so flip it into Wintab's convention first
+    const LONG y = lc.lcInOrgY + lc.lcInExtY - 1 - (ctx->y - lc.lcInOrgY);
+
+    PACKET pkt = {};
+    pkt.pkTime = (DWORD) (time.tv_sec * 1000 + time.tv_usec / 1000);
+    pkt.pkX = scaleAxis(ctx->x, lc.lcInOrgX, lc.lcInExtX, lc.lcOutOrgX, lc.lcOutExtX);
+    pkt.pkY = scaleAxis(y, lc.lcInOrgY, lc.lcInExtY, lc.lcOutOrgY, lc.lcOutExtY);
+    pkt.pkNormalPressure = ctx->inProximity && ctx->pressure > gDevice.pressure.minimum ? ctx->pressure : 0;
+    ctx->queue.push_back(pkt);
+}
+
+static void handleEvent(st_evdevContext *ctx, const input_event &event) {
+    if (event.type == EV_SYN) {
+        if (event.code == SYN_DROPPED) {
+            ctx->resyncing = true;
+        } else if (event.code == SYN_REPORT) {
+            if (ctx->resyncing) {
+                // the kernel lost events, pick the current axis values back up from the device
+                input_absinfo abs;
+                if (ioctl(gDevice.fd, EVIOCGABS(ABS_X), &abs) >= 0) ctx->x = abs.value;
+                if (ioctl(gDevice.fd, EVIOCGABS(ABS_Y), &abs) >= 0) ctx->y = abs.value;
+                if (ioctl(gDevice.fd, EVIOCGABS(ABS_PRESSURE), &abs) >= 0) ctx->pressure = abs.value;
+                ctx->resyncing = false;
+                ctx->changed = true;
+            }
+            if (ctx->changed) {
+                emitPacket(ctx, event.time);
+                ctx->changed = false;
+            }
+        }
+        return;
+    }
+
+    if (ctx->resyncing) {
+        return;
+    }
+
+    if (event.type == EV_ABS) {
+        switch (event.code) {
+            case ABS_X:
+                ctx->x = event.value;
+                ctx->changed = true;
+                break;
+            case ABS_Y:
+                ctx->y = event.value;
+                ctx->changed = true;
+                break;
+            case ABS_PRESSURE:
+                ctx->pressure = event.value;
+                ctx->changed = true;
+                break;
+            default:
+                break;
+        }
+    } else if (event.type == EV_KEY && (event.code == BTN_TOOL_PEN || event.code == BTN_TOOL_RUBBER)) {
+        ctx->inProximity = event.value != 0;
+        ctx->changed = true;
+    }
+}
+
+// Reads everything the kernel has queued, many events per syscall, and turns it into packets.
+static void pumpEvents(st_evdevContext *ctx) {
+    input_event events[EVDEV_READ_BATCH];
+    for (;;) {
+        const ssize_t bytes = read(gDevice.fd, events, sizeof(events));
+        if (bytes <= 0) {
+            // EAGAIN: nothing left. Anything else (ENODEV on unplug) also means no packets for now.
+            break;
+        }
+
+        const size_t count = bytes / sizeof(input_event);
+        for (size_t i = 0; i < count; ++i) {
+            handleEvent(ctx, events[i]);
+        }
+
+        if (count < EVDEV_READ_BATCH) {
+            // a short read means the kernel buffer is empty, skip the extra syscall
+            break;
+        }
+    }
+}
+
+bool API EvdevWTQueueSizeSet(HCTX hctx, int queueSize) {
+    if (!hctx || (st_evdevContext *) hctx != gContext || queueSize <= 0) {
+        return false;
+    }
+    // Wintab flushes the queue when resizing it
+    gContext->queue.clear();
+    gContext->queueSize = queueSize;
+    return true;
+}
+
+int API EvdevWTPacketsGet(HCTX hctx, int maxPackets, LPVOID packets) {
+    if (!hctx || (st_evdevContext *) hctx != gContext) {
+        return 0;
+    }
+    st_evdevContext *ctx = gContext;
+    pumpEvents(ctx);
+
+    int count = 0;
+    auto *out = (PACKET *) packets;
+    while (count < maxPackets && !ctx->queue.empty()) {
+        if (out) {
+            out[count] = ctx->queue.front();
+        }
+        ctx->queue.pop_front();
+        count++;
+    }
+    return count;
+}
+
+bool EvdevWaitForPackets(HCTX hctx, int timeoutMs) {
+    if (!hctx || (st_evdevContext *) hctx != gContext) {
+        return false;
+    }
+    if (!gContext->queue.empty()) {
+        return true;
+    }
+
+    pollfd device = {gDevice.fd, POLLIN, 0};
+    if (poll(&device, 1, timeoutMs) < 0) {
+        // EINTR: let the caller look again
+        return errno == EINTR;
+    }
+    return (device.revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+}
+
+// The rest of the API has no use on this backend yet.
+
+bool API EvdevWTEnable(HCTX hctx, bool enable) {
+    return hctx && (st_evdevContext *) hctx == gContext;
+}
+
+bool API EvdevWTPacket(HCTX hctx, UINT serial, LPVOID packet) {
+    return false;
+}
+
+bool API EvdevWTOverlap(HCTX hctx, bool toTop) {
+    return hctx && (st_evdevContext *) hctx == gContext;
+}
+
+bool API EvdevWTSave(HCTX hctx, LPVOID saveInfo) {
+    return false;
+}
+
+bool API EvdevWTConfig(HCTX hctx, HWND hwnd) {
+    return false;
+}
+
+HCTX API EvdevWTRestore(HWND hwnd, LPVOID saveInfo, bool enable) {
+    return nullptr;
+}
+
+bool API EvdevWTExtSet(HCTX hctx, UINT extension, LPVOID data) {
+    return false;
+}
+
+bool API EvdevWTExtGet(HCTX hctx, UINT extension, LPVOID data) {
+    return false;
+}
+
+int API EvdevWTDataPeek(HCTX hctx, UINT begin, UINT end, int maxPackets, LPVOID packets, LPINT count) {
+    return 0;
+}
+
+HMGR API EvdevWTMgrOpen(HWND hwnd, UINT msgBase) {
+    return nullptr;
+}
+
+bool API EvdevWTMgrClose(HMGR hmgr) {
+    return false;
+}
+
+HCTX API EvdevWTMgrDefContext(HMGR hmgr, bool system) {
+    return nullptr;
+}
+
+HCTX API EvdevWTMgrDefContextEx(HMGR hmgr, UINT device, bool system) {
+    return nullptr;
+}
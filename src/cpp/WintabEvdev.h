@@ -0,0 +1,63 @@
+#pragma once
+
+// Linux stand-in for Wintab32.dll. Implements the subset of the Wintab API the app uses on top of
+// a pen tablet's evdev node, so everything above the gpWT* function pointers stays the same.
+//
+// The tablet is the first /dev/input/event* device with absolute X/Y/pressure and a pen tool,
+// unless BAN_TABLET_DEVICE names a specific node. A uinput virtual tablet (see VirtualTablet.cpp)
+// is picked up like any other device.
+
+#include "Utils.h"
+
+// Finds and opens the tablet. Returns false if there is none.
+bool EvdevLoad();
+
+void EvdevUnload();
+
+// Screen rectangle the default system context maps the tablet onto, in desktop pixels.
+// Wintab gets this from Windows; evdev knows nothing about screens so the app has to tell us.
+void EvdevSetScreenArea(int x, int y, int width, int height);
+
+UINT API EvdevWTInfoA(UINT category, UINT index, LPVOID output);
+
+HCTX API EvdevWTOpenA(HWND hwnd, LPLOGCONTEXTA logContext, bool enable);
+
+bool API EvdevWTGetA(HCTX hctx, LPLOGCONTEXT logContext);
+
+bool API EvdevWTSetA(HCTX hctx, LPLOGCONTEXT logContext);
+
+bool API EvdevWTClose(HCTX hctx);
+
+bool API EvdevWTEnable(HCTX hctx, bool enable);
+
+bool API EvdevWTPacket(HCTX hctx, UINT serial, LPVOID packet);
+
+bool API EvdevWTOverlap(HCTX hctx, bool toTop);
+
+bool API EvdevWTSave(HCTX hctx, LPVOID saveInfo);
+
+bool API EvdevWTConfig(HCTX hctx, HWND hwnd);
+
+HCTX API EvdevWTRestore(HWND hwnd, LPVOID saveInfo, bool enable);
+
+bool API EvdevWTExtSet(HCTX hctx, UINT extension, LPVOID data);
+
+bool API EvdevWTExtGet(HCTX hctx, UINT extension, LPVOID data);
+
+bool API EvdevWTQueueSizeSet(HCTX hctx, int queueSize);
+
+int API EvdevWTDataPeek(HCTX hctx, UINT begin, UINT end, int maxPackets, LPVOID packets, LPINT count);
+
+int API EvdevWTPacketsGet(HCTX hctx, int maxPackets, LPVOID packets);
+
+// Not part of Wintab: blocks until the device has events or timeoutMs passes, so the input thread doesn't
+// have to poll. Returns false without waiting if the device can't be waited on (unplugged).
+bool EvdevWaitForPackets(HCTX hctx, int timeoutMs);
+
+HMGR API EvdevWTMgrOpen(HWND hwnd, UINT msgBase);
+
+bool API EvdevWTMgrClose(HMGR hmgr);
+
+HCTX API EvdevWTMgrDefContext(HMGR hmgr, bool system);
+
+HCTX API EvdevWTMgrDefContextEx(HMGR hmgr, UINT device, bool system);
@@ -1,30 +1,57 @@
 #define GLFW_INCLUDE_NONE
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
+#endif
 #define STB_IMAGE_IMPLEMENTATION
 
-#define PACKETDATA (PK_X | PK_Y | PK_BUTTONS | PK_NORMAL_PRESSURE | PK_TANGENT_PRESSURE | PK_TIME)
-#define PACKETMODE PK_BUTTONS
-
-#include "Utils.h"
+#include "CanvasTransform.h"
+#include "Damage.h"
+#include "InkTiles.h"
+#include "InputThread.h"
+#include "PacketFilter.h"
+#include "PacketSource.h"
+#include "Stroke.h"
+#include "StreamBuffer.h"
+#include "Viewport.h"
+#ifndef _WIN32
+#include "WintabEvdev.h"
+#endif
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
-#include <wacom-wintab/PKTDEF.H>
 #include <stb_image.h>
 
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <vector>
 
 // match aspect ratio of the texture (2526x1787)
 #define WIDTH 1272
 #define HEIGHT 900
 #define FRAMERATE 60
-#define MAX_PACKETS 20
-#define BRUSH_TEX_SIZE 256
-#define BRUSH_RADIUS 100  // percent
+#define PACKET_RING_SIZE 4096
+#define STAMP_REGION_SIZE 16384  // stamps per streaming buffer region
+#define STAMP_REGIONS 3
+// stamps made between two composites at most, so a burst of packets can't hold a frame up; the rest of the
+// stroke waits for the next frame. Generating and drawing a small stamp took about 1.8 us on llvmpipe, so
+// this is half a 60 Hz frame there. Large stamps cost more, up to ten times as much.
+#define STAMP_FRAME_BUDGET 4096
+#define PREDICTION_FRAMES 2  // how far ahead of the newest packet the stroke tip is predicted
+#define BRUSH_RADIUS 100  // percent of half the stamp
+#define BRUSH_HARDNESS 2.0f  // higher values keep full opacity further out from the center
+#define STAMP_TILE_SIZE 16  // local size of stampCompute.glsl
+// every tile a dispatch covers walks all of its stamps, so compute batches are kept short and local
+#define STAMP_COMPUTE_BATCH 256  // one shared-memory chunk in stampCompute.glsl
+#define INK_TILE_BUDGET 64  // megabytes of ink tiles kept on the GPU with --infinite
+#define PAN_STEP 32  // canvas pixels the arrow keys move the view by per composited frame
 
 struct st_shaderInfo {
     unsigned int type;
@@ -32,26 +59,27 @@ struct st_shaderInfo {
 } shaders[] = {
         {GL_VERTEX_SHADER,   "glsl/vertex.glsl"},
         {GL_FRAGMENT_SHADER, "glsl/fragment.glsl"},
+        {GL_VERTEX_SHADER,   "glsl/compositeVertex.glsl"},
+        {GL_FRAGMENT_SHADER, "glsl/compositeFragment.glsl"},
+        {GL_COMPUTE_SHADER,  "glsl/stampCompute.glsl"},
+        {GL_VERTEX_SHADER,   "glsl/capsuleVertex.glsl"},
+        {GL_FRAGMENT_SHADER, "glsl/capsuleFragment.glsl"},
         {GL_VERTEX_SHADER,   "glsl/backgroundVertex.glsl"},
-        {GL_FRAGMENT_SHADER, "glsl/backgroundFragment.glsl"},
-};
-
-struct st_inkData {
-    float x;
-    float y;
-    float size;
-};
-
-struct st_inkPoint {
-    st_inkData inkData;
-    int inkPointIndex;
+        {GL_FRAGMENT_SHADER, "glsl/strokeFragment.glsl"},
 };
 
 const double timePerFrame = 1.0 / FRAMERATE;
 bool shouldClearInk = false;
+bool shouldRedraw = true;
+// how far the arrow keys ask to move the view this frame, in ink layer pixels (rows go up)
+int panX = 0;
+int panY = 0;
 float inkMinSize = 5;
 float inkMaxSize = 20;
-float spacing = 1;
+// stamps are this fraction of their size apart
+float spacing = 0.25f;
+// packets closer than this to the previous one, in canvas pixels, are merged into it
+float deadZone = 0.5f;
 
 int createShader(unsigned int *shader, unsigned int type, const char *file) {
     *shader = glCreateShader(type);
@@ -111,6 +139,10 @@ void errorCallback(int error, const char *description) {
     std::cout << description << std::endl;
 }
 
+void refreshCallback(GLFWwindow *window) {
+    shouldRedraw = true;
+}
+
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
@@ -118,24 +150,71 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
         shouldClearInk = true;
     }
+    panX = panY = 0;
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+        panX -= PAN_STEP;
+    }
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+        panX += PAN_STEP;
+    }
+    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+        panY -= PAN_STEP;
+    }
+    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+        panY += PAN_STEP;
+    }
 }
 
-float module(float x, float y) {
-    return std::sqrt(x * x + y * y);
-}
-
-void fromPacketCoordsToWindowCoords(st_inkData *inkData, int window_x, int window_y) {
-    inkData->x = inkData->x - (float) window_x;
-    inkData->y = inkData->y - (float) window_y;
-}
-
-void fromWindowCoordsToCanvasCoords(st_inkData *inkData, int canvas_x, int canvas_y, int canvas_w, int canvasWidth) {
-    // canvas aspect ratio is fixed
-    inkData->x = (inkData->x - (float) canvas_x) * (float) canvasWidth / (float) canvas_w;
-    inkData->y = (inkData->y - (float) canvas_y) * (float) canvasWidth / (float) canvas_w;
-}
+int main(int argc, char **argv) {
+    const char *recordFile = nullptr;
+    const char *replayFile = nullptr;
+    bool replayFast = false;
+    bool predict = true;
+    bool computeStamps = false;
+    bool capsules = false;
+    bool deepInk = false;
+    const char *tileDirectory = nullptr;
+    int tileBudget = INK_TILE_BUDGET;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--fast") == 0) {
+            replayFast = true;
+        } else if (std::strcmp(argv[i], "--no-prediction") == 0) {
+            predict = false;
+        } else if (std::strcmp(argv[i], "--compute-stamps") == 0) {
+            computeStamps = true;
+        } else if (std::strcmp(argv[i], "--capsules") == 0) {
+            capsules = true;
+        } else if (std::strcmp(argv[i], "--16-bit-ink") == 0) {
+            deepInk = true;
+        } else if (std::strcmp(argv[i], "--dead-zone") == 0 && i + 1 < argc) {
+            deadZone = (float) std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--infinite") == 0 && i + 1 < argc) {
+            tileDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--tile-budget") == 0 && i + 1 < argc) {
+            tileBudget = std::atoi(argv[++i]);
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--record FILE] [--replay FILE [--fast]] [--no-prediction]"
+                      << " [--compute-stamps | --capsules] [--16-bit-ink] [--dead-zone PIXELS]"
+                      << " [--infinite DIRECTORY [--tile-budget MEGABYTES]]" << std::endl;
+            return -1;
+        }
+    }
+    if (tileBudget <= 0) {
+        std::cout << "Tile budget must be positive" << std::endl;
+        return -1;
+    }
+    if (!tileDirectory && tileBudget != INK_TILE_BUDGET) {
+        std::cout << "--tile-budget only applies with --infinite, ignoring it" << std::endl;
+    }
+    if (computeStamps && capsules) {
+        std::cout << "--compute-stamps only draws stamps, ignoring it" << std::endl;
+        computeStamps = false;
+    }
 
-int main() {
     glfwSetErrorCallback(errorCallback);
 
     if (!glfwInit()) {
@@ -156,6 +235,7 @@ int main() {
     }
 
     glfwMakeContextCurrent(window);
+    glfwSetWindowRefreshCallback(window, refreshCallback);
 
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
@@ -172,79 +252,92 @@ int main() {
         return -1;
     }
 
-    unsigned int bgProgram;
-    if (!createAndLinkProgram(&bgProgram, shaders + 2, 2)) {
+    unsigned int compositeProgram;
+    if (!createAndLinkProgram(&compositeProgram, shaders + 2, 2)) {
         std::cout << "Failed to create program" << std::endl;
         glDeleteProgram(mainProgram);
         glfwTerminate();
         return -1;
     }
 
-    if (!LoadWintab()) {
-        std::cout << "Failed to initialize WINTAB" << std::endl;
+    unsigned int stampComputeProgram;
+    if (!createAndLinkProgram(&stampComputeProgram, shaders + 4, 1)) {
+        std::cout << "Failed to create program" << std::endl;
         glDeleteProgram(mainProgram);
-        glDeleteProgram(bgProgram);
+        glDeleteProgram(compositeProgram);
         glfwTerminate();
         return -1;
     }
 
-    LOGCONTEXT lcMine = {0};
-    AXIS tabletX = {0};
-    AXIS tabletY = {0};
-    AXIS pressure = {0};
-    HCTX hctx = nullptr;
-    if (gpWTInfoA(WTI_DEFSYSCTX, 0, &lcMine) > 0) {
-        UINT result;
-        gpWTInfoA(WTI_DEVICES, DVC_HARDWARE, &result);
-        bool displayTablet = result & HWC_INTEGRATED;
-
-        gpWTInfoA(WTI_DEVICES, DVC_PKTRATE, &result);
-        std::cout << "pktrate: " << result << std::endl;
-
-        char name[1024];
-        gpWTInfoA(WTI_DEVICES + -1, DVC_NAME, name);
-        std::cout << "name: " << name << std::endl;
-
-        std::cout << "type: " << (displayTablet ? "display (integrated)" : "opaque") << std::endl;
-
-        lcMine.lcPktData = PACKETDATA;
-        lcMine.lcOptions |= CXO_MESSAGES;
-        lcMine.lcOptions |= CXO_SYSTEM;  // move system cursor
-        lcMine.lcPktMode = PACKETMODE;
-        lcMine.lcMoveMask = PACKETDATA;
-        lcMine.lcBtnUpMask = lcMine.lcBtnDnMask;
-
-        // Set the entire tablet as active
-        UINT wWTInfoRetVal = gpWTInfoA(WTI_DEVICES, DVC_X, &tabletX);
-        if (wWTInfoRetVal != sizeof(AXIS)) {
-            std::cout << "This context should not be opened. ?????" << std::endl;
-        } else {
-            gpWTInfoA(WTI_DEVICES, DVC_Y, &tabletY);
-            gpWTInfoA(WTI_DEVICES, DVC_NPRESSURE, &pressure);
-            std::cout << "x: " << tabletX.axMin << ", " << tabletX.axMax << std::endl;
-            std::cout << "y: " << tabletY.axMin << ", " << tabletY.axMax << std::endl;
-            std::cout << "pressure: " << pressure.axMin << ", " << pressure.axMax << std::endl;
+    unsigned int capsuleProgram;
+    if (!createAndLinkProgram(&capsuleProgram, shaders + 5, 2)) {
+        std::cout << "Failed to create program" << std::endl;
+        glDeleteProgram(mainProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glfwTerminate();
+        return -1;
+    }
 
-            // In Wintab, the tablet origin is lower left. Move origin to upper left so that it coincides with screen origin.
-            lcMine.lcOutExtY = -lcMine.lcOutExtY;
+    // inks a finished stroke from its coverage buffer into the ink layer
+    unsigned int strokeCommitProgram;
+    if (!createAndLinkProgram(&strokeCommitProgram, shaders + 7, 2)) {
+        std::cout << "Failed to create program" << std::endl;
+        glDeleteProgram(mainProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glDeleteProgram(capsuleProgram);
+        glfwTerminate();
+        return -1;
+    }
 
-            hctx = gpWTOpenA(glfwGetWin32Window(window), &lcMine, true);
+    std::unique_ptr<PacketSource> packetSource;
+    ReplayPacketSource *replaySource = nullptr;
+    WintabPacketSource *wintabSource = nullptr;
+    if (replayFile) {
+        auto replay = std::make_unique<ReplayPacketSource>();
+        if (replay->open(replayFile, !replayFast)) {
+            replaySource = replay.get();
+            packetSource = std::move(replay);
+        }
+    } else {
+        auto wintab = std::make_unique<WintabPacketSource>();
+#ifdef _WIN32
+        HWND hwnd = glfwGetWin32Window(window);
+#else
+        // the evdev backend maps the tablet onto the primary monitor
+        const GLFWvidmode *videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        EvdevSetScreenArea(0, 0, videoMode->width, videoMode->height);
+        HWND hwnd = nullptr;
+#endif
+        if (wintab->open(hwnd, timePerFrame)) {
+            wintabSource = wintab.get();
+            packetSource = std::move(wintab);
+        }
+    }
+    if (packetSource && recordFile) {
+        auto recording = std::make_unique<RecordingPacketSource>(std::move(packetSource));
+        if (recording->open(recordFile)) {
+            packetSource = std::move(recording);
         }
     }
 
-    if (!hctx) {
-        std::cout << "Failed to initialize WINTAB context" << std::endl;
-        UnloadWintab();
+    if (!packetSource) {
+        std::cout << "Failed to open packet source" << std::endl;
         glDeleteProgram(mainProgram);
-        glDeleteProgram(bgProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glDeleteProgram(capsuleProgram);
+        glDeleteProgram(strokeCommitProgram);
         glfwTerminate();
         return -1;
     }
+    const AXIS pressure = packetSource->pressureAxis();
 
     glEnable(GL_BLEND);
     glClearColor(0, 0, 0, 0);
 
-    unsigned int bgTexture, brushTexture, inkLayerTexture;
+    unsigned int bgTexture;
     glGenTextures(1, &bgTexture);
     glBindTexture(GL_TEXTURE_2D, bgTexture);
     // default values require mipmaps so we define these
@@ -260,278 +353,608 @@ int main() {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, bgWidth, bgHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, bg_data);
     stbi_image_free(bg_data);
 
-    glGenTextures(1, &brushTexture);
-    glBindTexture(GL_TEXTURE_2D, brushTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    unsigned char *brush_data = (unsigned char *) malloc(BRUSH_TEX_SIZE * BRUSH_TEX_SIZE);
-    const int radius_squared = 1L * BRUSH_TEX_SIZE * BRUSH_RADIUS * BRUSH_TEX_SIZE * BRUSH_RADIUS / (2 * 100 * 2 * 100);
-    for (int i = 0; i < BRUSH_TEX_SIZE; ++i) {
-        for (int j = 0; j < BRUSH_TEX_SIZE; ++j) {
-            const int x = i - BRUSH_TEX_SIZE / 2;
-            const int y = j - BRUSH_TEX_SIZE / 2;
-            const int dist_squared = x * x + y * y;
-            const int val = 255 - dist_squared * 256 / radius_squared;
-            brush_data[i + j * BRUSH_TEX_SIZE] = val < 0 ? 0 : val > 255 ? 255: val;
-        }
+    // The ink is all one color, so the layer only keeps how much of it covers each pixel and the color is
+    // put on when compositing. 16 bits make faint ink build up more smoothly over many strokes.
+    // It is kept in tiles made as strokes reach them, so blank parts of the canvas take no memory.
+    // With --infinite the view can be moved anywhere, and tiles it left behind go to disk past the budget.
+    TileStore tileStore;
+    InkTiles inkTiles;
+    const size_t tileBytes = (size_t) INK_TILE_SIZE * INK_TILE_SIZE * (deepInk ? 2 : 1);
+    const bool tilesCreated = tileDirectory ?
+                              tileStore.open(tileDirectory, tileBytes, glfwPostEmptyEvent) &&
+                              inkTiles.create(bgWidth, bgHeight, deepInk ? GL_R16 : GL_R8,
+                                              (int) ((size_t) tileBudget * 1024 * 1024 / tileBytes), &tileStore) :
+                              inkTiles.create(bgWidth, bgHeight, deepInk ? GL_R16 : GL_R8);
+    if (!tilesCreated) {
+        std::cout << "Failed to create ink tiles" << std::endl;
+        packetSource = nullptr;
+        inkTiles.destroy();
+        glDeleteProgram(mainProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glDeleteProgram(capsuleProgram);
+        glDeleteProgram(strokeCommitProgram);
+        glfwTerminate();
+        return -1;
     }
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, BRUSH_TEX_SIZE, BRUSH_TEX_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, brush_data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    free(brush_data);
 
-    glGenTextures(1, &inkLayerTexture);
-    glBindTexture(GL_TEXTURE_2D, inkLayerTexture);
+    // coverage of the stroke in progress, same size as the ink layer
+    unsigned int strokeTexture;
+    glGenTextures(1, &strokeTexture);
+    glBindTexture(GL_TEXTURE_2D, strokeTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, bgWidth, bgHeight, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bgWidth, bgHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-    unsigned int inkingFbo;
-    glGenFramebuffers(1, &inkingFbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, inkingFbo);
-
-    // make sure the thing is empty
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, inkLayerTexture, 0);
+    unsigned int strokeFbo;
+    glGenFramebuffers(1, &strokeFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, strokeFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, strokeTexture, 0);
     glClear(GL_COLOR_BUFFER_BIT);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cout << "Inking FRAMEBUFFER not complete" << std::endl;
-        UnloadWintab();
-        glDeleteFramebuffers(1, &inkingFbo);
+        std::cout << "Stroke FRAMEBUFFER not complete" << std::endl;
+        packetSource = nullptr;
+        glDeleteFramebuffers(1, &strokeFbo);
+        glDeleteTextures(1, &strokeTexture);
+        inkTiles.destroy();
         glDeleteProgram(mainProgram);
-        glDeleteProgram(bgProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glDeleteProgram(capsuleProgram);
+        glDeleteProgram(strokeCommitProgram);
         glfwTerminate();
         return -1;
     }
 
-    unsigned int vao, vbo;
+    unsigned int vao;
     glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-
     glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
+    // stamps are written straight into this buffer by the stroke builder and predictor
+    StreamBuffer stampBuffer;
+    if (!stampBuffer.create(sizeof(st_inkData), STAMP_REGION_SIZE, STAMP_REGIONS)) {
+        std::cout << "Failed to create stamp buffer" << std::endl;
+        packetSource = nullptr;
+        stampBuffer.destroy();
+        glDeleteVertexArrays(1, &vao);
+        glDeleteFramebuffers(1, &strokeFbo);
+        glDeleteTextures(1, &strokeTexture);
+        inkTiles.destroy();
+        glDeleteProgram(mainProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glDeleteProgram(capsuleProgram);
+        glDeleteProgram(strokeCommitProgram);
+        glfwTerminate();
+        return -1;
+    }
+
+    // one st_inkData per stamp instance, the vertex shader builds the quad corners from gl_VertexID
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(st_inkData), (void *) nullptr);
+    glVertexAttribDivisor(0, 1);
+
+    // capsules read the same buffer two stamps at a time, the start and end of each capsule
+    unsigned int capsuleVao;
+    glGenVertexArrays(1, &capsuleVao);
+    glBindVertexArray(capsuleVao);
+    glBindBuffer(GL_ARRAY_BUFFER, stampBuffer.buffer());
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float) + sizeof(int), (void *) nullptr);
-    glVertexAttribIPointer(1, 1, GL_INT, 3 * sizeof(float) + sizeof(int), (void *) (3 * sizeof(float)));
-
-    unsigned int bgVao, bgVbo;
-    glGenVertexArrays(1, &bgVao);
-    glGenBuffers(1, &bgVbo);
-
-    glBindVertexArray(bgVao);
-    glBindBuffer(GL_ARRAY_BUFFER, bgVbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(st_inkData), (void *) nullptr);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(st_inkData), (void *) sizeof(st_inkData));
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+
+    // the compositor's triangle comes from gl_VertexID, but something has to be bound to draw it
+    unsigned int compositeVao;
+    glGenVertexArrays(1, &compositeVao);
+
+    // the whole canvas, for inking a finished stroke into the ink layer
+    unsigned int strokeVao, strokeVbo;
+    glGenVertexArrays(1, &strokeVao);
+    glGenBuffers(1, &strokeVbo);
+
+    glBindVertexArray(strokeVao);
+    glBindBuffer(GL_ARRAY_BUFFER, strokeVbo);
+
+    const int strokeVertices[] = {
+            0, 0, 0, 1,
+            0, bgHeight, 0, 0,
+            bgWidth, bgHeight, 1, 0,
+            0, 0, 0, 1,
+            bgWidth, bgHeight, 1, 0,
+            bgWidth, 0, 1, 1
+    };
+    glBufferData(GL_ARRAY_BUFFER, sizeof(strokeVertices), strokeVertices, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glVertexAttribIPointer(0, 2, GL_INT, 4 * sizeof(int), (void *) nullptr);
     glVertexAttribIPointer(1, 2, GL_INT, 4 * sizeof(int), (void *) (2 * sizeof(int)));
 
-    std::vector<st_inkPoint> inkPoints;
-    bool stroking = false;
-    float leftoverDistance = 0;
-    st_inkData prev = {};
-
-    double lastRender = 0;
-    while (!glfwWindowShouldClose(window)) {
-        const double now = glfwGetTime();
+    // these never change, set them once
+    for (unsigned int program : {mainProgram, stampComputeProgram, capsuleProgram}) {
+        glUseProgram(program);
+        glUniform1i(0, bgWidth);
+        glUniform1i(1, bgHeight);
+        glUniform1i(2, (int) pressure.axMax);
+        glUniform1f(3, inkMinSize);
+        glUniform1f(4, inkMaxSize);
+        glUniform1f(8, (float) BRUSH_RADIUS / 200);
+        glUniform1f(9, BRUSH_HARDNESS);
+    }
+    glUseProgram(strokeCommitProgram);
+    glUniform1i(0, bgWidth);
+    glUniform1i(1, bgHeight);
+    glUseProgram(compositeProgram);
+    glUniform2i(3, bgWidth, bgHeight);
+    glUniform1f(8, (float) BRUSH_RADIUS / 200);
+    glUniform1f(9, BRUSH_HARDNESS);
+
+    Viewport viewport(bgWidth, bgHeight);
+    viewport.attach(window);
+    // generation of the viewport the composite placement was worked out for
+    uint64_t compositeGeneration = 0;
+
+    // The window as last composited. Only what changed is redrawn into it, then the whole of it is
+    // copied to the back buffer, whose contents GLFW can't tell us the age of.
+    unsigned int compositeTexture;
+    glGenTextures(1, &compositeTexture);
+    glBindTexture(GL_TEXTURE_2D, compositeTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, std::max(viewport.geometry().framebuffer_w, 1),
+                 std::max(viewport.geometry().framebuffer_h, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    unsigned int compositeFbo;
+    glGenFramebuffers(1, &compositeFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, compositeFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositeTexture, 0);
 
-        int window_x, window_y, window_w, window_h;
-        glfwGetWindowPos(window, &window_x, &window_y);
-        glfwGetWindowSize(window, &window_w, &window_h);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Composite FRAMEBUFFER not complete" << std::endl;
+        packetSource = nullptr;
+        stampBuffer.destroy();
+        glDeleteFramebuffers(1, &compositeFbo);
+        glDeleteTextures(1, &compositeTexture);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteVertexArrays(1, &capsuleVao);
+        glDeleteVertexArrays(1, &compositeVao);
+        glDeleteVertexArrays(1, &strokeVao);
+        glDeleteBuffers(1, &strokeVbo);
+        glDeleteFramebuffers(1, &strokeFbo);
+        glDeleteTextures(1, &strokeTexture);
+        inkTiles.destroy();
+        glDeleteProgram(mainProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteProgram(stampComputeProgram);
+        glDeleteProgram(capsuleProgram);
+        glDeleteProgram(strokeCommitProgram);
+        glfwTerminate();
+        return -1;
+    }
 
-        const double windowAspectRatio = (double) window_w / window_h;
-        const double bgAspectRatio = (double) bgWidth / bgHeight;
+    // what has to be redrawn into the composite next frame
+    DamageRegion damage;
+
+    // how far from its center, in canvas pixels, a stamp of this size can ink
+    auto stampReach = [&](float size) {
+        return (inkMinSize + size * (inkMaxSize - inkMinSize) / (float) pressure.axMax) / 2 + 3;
+    };
+
+    // The pixels stamps within bounds can touch, clipped to the canvas. Rows of the ink layer count up
+    // from the bottom of the canvas. False if that's none.
+    auto stampPixels = [&](const st_stampBounds &bounds, int *left, int *bottom, int *right, int *top) {
+        const float reach = stampReach(bounds.maxSize);
+        *left = std::max(0, (int) (bounds.minX - reach));
+        *right = std::min(bgWidth, (int) (bounds.maxX + reach) + 1);
+        *bottom = std::max(0, (int) ((float) bgHeight - bounds.maxY - reach));
+        *top = std::min(bgHeight, (int) ((float) bgHeight - bounds.minY + reach) + 1);
+        return *left < *right && *bottom < *top;
+    };
+
+    // The same pixels on screen, where the composite has to be redrawn.
+    auto damageStamps = [&](const st_stampBounds &bounds) {
+        const st_viewportGeometry &view = viewport.geometry();
+        // minimized, nothing is on screen; the whole framebuffer is damaged once it has a size again
+        if (view.window_w <= 0 || view.window_h <= 0 || view.framebuffer_w <= 0 || view.framebuffer_h <= 0) {
+            return;
+        }
+        const float reach = stampReach(bounds.maxSize);
+        const float pixels_x = (float) view.framebuffer_w / (float) view.window_w;
+        const float pixels_y = (float) view.framebuffer_h / (float) view.window_h;
+        const float scale_x = (float) view.canvas_w / (float) bgWidth * pixels_x;
+        const float scale_y = (float) view.canvas_h / (float) bgHeight * pixels_y;
+        // canvas rows go down from the top of the canvas, framebuffer rows up from the bottom of the window
+        const float left = (float) view.canvas_x * pixels_x + (bounds.minX - reach) * scale_x;
+        const float right = (float) view.canvas_x * pixels_x + (bounds.maxX + reach) * scale_x;
+        const float canvasTop = (float) (view.window_h - view.canvas_y) * pixels_y;
+        const float bottom = canvasTop - (bounds.maxY + reach) * scale_y;
+        const float top = canvasTop - (bounds.minY - reach) * scale_y;
+        // a pixel more all around for the linear filtering of the layers
+        damage.add({(int) left - 1, (int) bottom - 1, (int) (right - left) + 3, (int) (top - bottom) + 3});
+    };
+
+    // ink layer pixel at the bottom left of the view; the stroke buffer and stamps stay relative to the view
+    int viewLeft = 0;
+    int viewBottom = 0;
+
+    // everything stamped into the stroke coverage buffer since it was last cleared
+    st_stampBounds strokeBounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0};
+    StampStream inkStamps(stampBuffer, [&](size_t first, size_t count, const st_stampBounds &bounds) {
+        strokeBounds.minX = std::min(strokeBounds.minX, bounds.minX);
+        strokeBounds.minY = std::min(strokeBounds.minY, bounds.minY);
+        strokeBounds.maxX = std::max(strokeBounds.maxX, bounds.maxX);
+        strokeBounds.maxY = std::max(strokeBounds.maxY, bounds.maxY);
+        strokeBounds.maxSize = std::max(strokeBounds.maxSize, bounds.maxSize);
+        damageStamps(bounds);
+        shouldRedraw = true;
+
+        if (computeStamps) {
+            // the tiles the batch can touch
+            int left, bottom, right, top;
+            if (!stampPixels(bounds, &left, &bottom, &right, &top)) {
+                return;
+            }
+            const int tileX = left / STAMP_TILE_SIZE * STAMP_TILE_SIZE;
+            const int tileY = bottom / STAMP_TILE_SIZE * STAMP_TILE_SIZE;
+
+            glUseProgram(stampComputeProgram);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, stampBuffer.buffer());
+            glBindImageTexture(0, strokeTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R8);
+            glUniform1i(5, (int) first);
+            glUniform1i(6, (int) count);
+            glUniform2i(7, tileX, tileY);
+            glDispatchCompute((right - tileX + STAMP_TILE_SIZE - 1) / STAMP_TILE_SIZE,
+                              (top - tileY + STAMP_TILE_SIZE - 1) / STAMP_TILE_SIZE, 1);
+            // the next batch reads these pixels back, the compositor samples them and they're cleared at
+            // the end of the stroke
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT |
+                            GL_FRAMEBUFFER_BARRIER_BIT);
+            return;
+        }
 
-        int canvas_x, canvas_y, canvas_w, canvas_h;
+        // stamps of one stroke keep the highest coverage instead of piling up
+        glBindFramebuffer(GL_FRAMEBUFFER, strokeFbo);
+        glViewport(0, 0, bgWidth, bgHeight);
+        glBlendEquation(GL_MAX);
 
-        if (bgAspectRatio < windowAspectRatio) {
-            canvas_w = window_h * bgWidth / bgHeight;
-            canvas_h = window_h;
-            canvas_x = (window_w - canvas_w) / 2;
-            canvas_y = 0;
+        if (capsules) {
+            glUseProgram(capsuleProgram);
+            glBindVertexArray(capsuleVao);
+            glUniform1i(10, true);
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, (int) count / 2, (unsigned int) first / 2);
         } else {
-            canvas_w = window_w;
-            canvas_h = window_w * bgHeight / bgWidth;
-            canvas_x = 0;
-            canvas_y = (window_h - canvas_h) / 2;
+            glUseProgram(mainProgram);
+            glBindVertexArray(vao);
+            glUniform1i(10, true);
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, (int) count, (unsigned int) first);
         }
+        glBlendEquation(GL_FUNC_ADD);
+    }, computeStamps ? STAMP_COMPUTE_BATCH : 0);
+    // The predicted tip goes straight to the screen with the ink shader, over the ink layer, and is
+    // rebuilt every frame so real packets replace it.
+    size_t predictedCount = 0;
+    StampStream predictedStamps(stampBuffer, [&](size_t first, size_t count, const st_stampBounds &bounds) {
+        // the canvas rect in framebuffer pixels, which start at the bottom left
+        const st_viewportGeometry &view = viewport.geometry();
+        const float scale_x = (float) view.framebuffer_w / (float) view.window_w;
+        const float scale_y = (float) view.framebuffer_h / (float) view.window_h;
+        glViewport((int) ((float) view.canvas_x * scale_x),
+                   (int) ((float) (view.window_h - view.canvas_y - view.canvas_h) * scale_y),
+                   (int) ((float) view.canvas_w * scale_x), (int) ((float) view.canvas_h * scale_y));
+
+        if (capsules) {
+            glUseProgram(capsuleProgram);
+            glBindVertexArray(capsuleVao);
+            glUniform1i(10, false);
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, (int) count / 2, (unsigned int) first / 2);
+        } else {
+            glUseProgram(mainProgram);
+            glBindVertexArray(vao);
+            glUniform1i(10, false);
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, (int) count, (unsigned int) first);
+        }
+        predictedCount += count;
+    });
+    // Inks the finished stroke into the ink layer and clears its coverage, only where it was stamped.
+    auto commitStroke = [&]() {
+        inkStamps.flush();
+        int left, bottom, right, top;
+        if (stampPixels(strokeBounds, &left, &bottom, &right, &top)) {
+            // coverage over coverage: s + ink * (1 - s)
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            glUseProgram(strokeCommitProgram);
+            glBindVertexArray(strokeVao);
+            // tile by tile, the canvas quad shifted so the tile's corner lands on the viewport's
+            for (int tile_y = inkTileOf(viewBottom + bottom); tile_y <= inkTileOf(viewBottom + top - 1); ++tile_y) {
+                for (int tile_x = inkTileOf(viewLeft + left); tile_x <= inkTileOf(viewLeft + right - 1); ++tile_x) {
+                    if (!inkTiles.bindTile(tile_x, tile_y)) {
+                        continue;
+                    }
+                    // a new tile's entry in the table is written through the same texture unit
+                    glBindTexture(GL_TEXTURE_2D, strokeTexture);
+                    const int tile_left = tile_x * INK_TILE_SIZE - viewLeft;
+                    const int tile_bottom = tile_y * INK_TILE_SIZE - viewBottom;
+                    glViewport(-tile_left, -tile_bottom, bgWidth, bgHeight);
+                    glEnable(GL_SCISSOR_TEST);
+                    glScissor(left - tile_left, bottom - tile_bottom, right - left, top - bottom);
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                    glDisable(GL_SCISSOR_TEST);
+                }
+            }
 
-        processInput(window);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, inkingFbo);
-        glViewport(0, 0, bgWidth, bgHeight);
-
-        if (shouldClearInk) {
+            glBindFramebuffer(GL_FRAMEBUFFER, strokeFbo);
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(left, bottom, right - left, top - bottom);
             glClear(GL_COLOR_BUFFER_BIT);
-            shouldClearInk = false;
+            glDisable(GL_SCISSOR_TEST);
+            // looks the same from the ink layer, up to rounding
+            damageStamps(strokeBounds);
+            shouldRedraw = true;
         }
+        strokeBounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0};
+    };
+    const st_stampSpacing stampSpacing = {inkMinSize, inkMaxSize, (float) pressure.axMax, spacing};
+    StrokeBuilder strokeBuilder(stampSpacing, capsules);
+    StrokePredictor strokePredictor(stampSpacing, capsules);
+    double lastPacketTime = 0;
+
+    // new packets wake the main loop up, see the end of the loop
+    InputThread inputThread(packetSource.get(), PACKET_RING_SIZE, replaySource != nullptr, glfwPostEmptyEvent);
+    inputThread.start();
+    std::vector<PACKET> packets;
+    CanvasTransformer canvasTransformer;
+    st_canvasPoints canvasPoints;
+    PacketFilter packetFilter(deadZone);
+    // points that didn't fit in the stamp budget, oldest first
+    std::deque<st_inputPoint> backlog;
+    inkStamps.limit(STAMP_FRAME_BUDGET);
+    // A finished stroke is only inked into the tiles once the store has read back the ones the view
+    // reached. Meanwhile it stays in the stroke buffer, and the next one can't start.
+    bool strokeEnded = false;
+    int budgetFrames = 0;  // frames that ran out of budget
+    size_t backlogHighWater = 0;
+
+    const double startTime = glfwGetTime();
+    int renderedFrames = 0;
 
-        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    double lastRender = 0;
+    while (!glfwWindowShouldClose(window)) {
+        const double now = glfwGetTime();
 
-        glUseProgram(mainProgram);
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBindTexture(GL_TEXTURE_2D, brushTexture);
+        const st_viewportGeometry &view = viewport.geometry();
+        if (viewport.generation() != compositeGeneration) {
+            damage.resize(view.framebuffer_w, view.framebuffer_h);
+            shouldRedraw = true;
+        }
 
-        glUniform1i(0, bgWidth);
-        glUniform1i(1, bgHeight);
-        glUniform1i(2, (int) pressure.axMax);
-        glUniform1f(3, inkMinSize);
-        glUniform1f(4, inkMaxSize);
+        processInput(window);
+        // a frame gets composited this time round if anything needs redrawing
+        const bool frameDue = now >= lastRender + timePerFrame && view.framebuffer_w > 0 && view.framebuffer_h > 0;
 
-        PACKET packets[MAX_PACKETS];
-        int numPackets = gpWTPacketsGet(hctx, MAX_PACKETS, (LPVOID) packets);
-        if (numPackets >= MAX_PACKETS - 5) {
-            std::cout << "Packets received: " << numPackets << std::endl;
-        }
+        packets.clear();
+        const int numPackets = (int) inputThread.drain(packets);
         if (numPackets > 0) {
-            for (int i = 0; i < numPackets; i++) {
-                PACKET pkt = packets[i];
-                // std::cout << "Packet #" << i <<
-                //           " - X: " << pkt.pkX <<
-                //           "  Y: " << pkt.pkY <<
-                //           "  pressure: " << pkt.pkNormalPressure <<
-                //           "  time: " << pkt.pkTime <<
-                //           std::endl;
-
-                if (!stroking) {
-                    if (pkt.pkNormalPressure == 0) {
-                        continue;
-                    }
-
-                    // first point
-                    st_inkData ink = {(float) pkt.pkX, (float) pkt.pkY, (float) pkt.pkNormalPressure};
-                    fromPacketCoordsToWindowCoords(&ink, window_x, window_y);
-                    fromWindowCoordsToCanvasCoords(&ink, canvas_x, canvas_y, canvas_w, bgWidth);
-                    inkPoints.push_back({ink, 1});
-                    inkPoints.push_back({ink, 2});
-                    inkPoints.push_back({ink, 3});
-                    inkPoints.push_back({ink, 1});
-                    inkPoints.push_back({ink, 3});
-                    inkPoints.push_back({ink, 4});
-
-                    stroking = true;
-                    leftoverDistance = 0;
-                    prev = ink;
-                    continue;
-                }
+            lastPacketTime = now;
+        }
+        if (shouldClearInk) {
+            inkTiles.clear();
+            glBindFramebuffer(GL_FRAMEBUFFER, strokeFbo);
+            glClear(GL_COLOR_BUFFER_BIT);
+            strokeBounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0};
+            strokeEnded = false;
+            shouldClearInk = false;
+            damage.addAll();
+            shouldRedraw = true;
+        }
+        // Only between strokes, the one being drawn is relative to where the view was. One step per composited
+        // frame, however often packets and window events wake the loop in between.
+        if (tileDirectory && (panX != 0 || panY != 0) && frameDue && !strokeBuilder.stroking() && !strokeEnded &&
+            backlog.empty()) {
+            viewLeft += panX;
+            viewBottom += panY;
+            inkTiles.setWindow(viewLeft, viewBottom);
+            damage.addAll();
+            shouldRedraw = true;
+        }
+        if (inkTiles.update()) {
+            damage.addAll();
+            shouldRedraw = true;
+        }
 
-                if (pkt.pkNormalPressure == 0) {
-                    // finish stroke;
-                    stroking = false;
-                    continue;
-                }
+        canvasTransformer.transform(viewport.packetToCanvas(), packets.data(), numPackets, canvasPoints);
+        packetFilter.filter(canvasPoints);
+        for (size_t i = 0; i < canvasPoints.size(); i++) {
+            backlog.push_back({canvasPoints.x[i], canvasPoints.y[i], canvasPoints.pressure[i], canvasPoints.time[i]});
+        }
+        backlogHighWater = std::max(backlogHighWater, backlog.size());
 
-                st_inkData ink = {(float) pkt.pkX, (float) pkt.pkY, (float) pkt.pkNormalPressure};
-                fromPacketCoordsToWindowCoords(&ink, window_x, window_y);
-                fromWindowCoordsToCanvasCoords(&ink, canvas_x, canvas_y, canvas_w, bgWidth);
-
-                float dist = module(ink.x - prev.x, ink.y - prev.y);
-                float count = 1;
-                while (spacing * count <= dist + leftoverDistance) {
-                    float scaling = (spacing * count - leftoverDistance) / dist;
-                    // point = (prev_to_curr / dist) * spacing * count
-                    st_inkData fillerInk = {
-                            prev.x + (ink.x - prev.x) * scaling,
-                            prev.y + (ink.y - prev.y) * scaling,
-                            prev.size + (ink.size - prev.size) * scaling
-                    };
-                    inkPoints.push_back({fillerInk, 1});
-                    inkPoints.push_back({fillerInk, 2});
-                    inkPoints.push_back({fillerInk, 3});
-                    inkPoints.push_back({fillerInk, 1});
-                    inkPoints.push_back({fillerInk, 3});
-                    inkPoints.push_back({fillerInk, 4});
-
-                    count++;
+        // the sink stops the stroke builder mid-segment once the budget is spent, and it goes on from there
+        const bool budgetLeft = inkStamps.room() > 0;
+        if (strokeEnded && inkTiles.loading() == 0) {
+            commitStroke();
+            strokeEnded = false;
+        }
+        strokeBuilder.catchUp(inkStamps);
+        while (!strokeEnded && !backlog.empty() && !strokeBuilder.behind() && inkStamps.room() > 0) {
+            const bool wasStroking = strokeBuilder.stroking();
+            strokeBuilder.addPoint(backlog.front(), inkStamps);
+            backlog.pop_front();
+            if (wasStroking && !strokeBuilder.stroking()) {
+                if (inkTiles.loading() == 0) {
+                    commitStroke();
+                } else {
+                    strokeEnded = true;
                 }
-                leftoverDistance += dist - spacing * (count - 1);
-                prev = ink;
             }
         }
-        glBufferData(GL_ARRAY_BUFFER, sizeof(int) * 4 * inkPoints.size(), inkPoints.data(),
-                     GL_STATIC_DRAW);
-        glDrawArrays(GL_TRIANGLES, 0, (int) inkPoints.size());
-        inkPoints.clear();
+        const bool caughtUp = backlog.empty() && !strokeBuilder.behind() && !strokeEnded;
+        if (budgetLeft && !caughtUp) {
+            budgetFrames++;
+        }
+
+        inkStamps.flush();
 
-        if (now >= lastRender + timePerFrame) {
+        if (shouldRedraw && frameDue) {
             lastRender = now;
 
-            int framebuffer_w, framebuffer_h;
-            glfwGetFramebufferSize(window, &framebuffer_w, &framebuffer_h);
-
-            const int bgVertices[] = {
-                    canvas_x, canvas_y, 0, 1,
-                    canvas_x, canvas_y + canvas_h, 0, 0,
-                    canvas_x + canvas_w, canvas_y + canvas_h, 1, 0,
-                    canvas_x, canvas_y, 0, 1,
-                    canvas_x + canvas_w, canvas_y + canvas_h, 1, 0,
-                    canvas_x + canvas_w, canvas_y, 1, 1
-            };
-
-            const int brushVertices[] = {
-                    window_w - 200, 25, 0, 1,
-                    window_w - 200, 200, 0, 0,
-                    window_w - 25, 200, 1, 0,
-                    window_w - 200, 25, 0, 1,
-                    window_w - 25, 200, 1, 0,
-                    window_w - 25, 25, 1, 1
-            };
+            glUseProgram(compositeProgram);
 
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glViewport(0, 0, framebuffer_w, framebuffer_h);
+            // where the canvas and the brush preview go, in framebuffer pixels; only worked out on resize
+            if (compositeGeneration != viewport.generation()) {
+                compositeGeneration = viewport.generation();
 
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            glUseProgram(bgProgram);
-            glBindVertexArray(bgVao);
-            glBindBuffer(GL_ARRAY_BUFFER, bgVbo);
+                const float pixels_x = (float) view.framebuffer_w / (float) view.window_w;
+                const float pixels_y = (float) view.framebuffer_h / (float) view.window_h;
+                glUniform4f(0, (float) view.canvas_x * pixels_x,
+                            (float) (view.window_h - view.canvas_y - view.canvas_h) * pixels_y,
+                            (float) view.canvas_w * pixels_x, (float) view.canvas_h * pixels_y);
+                glUniform4f(1, (float) (view.window_w - 200) * pixels_x, (float) (view.window_h - 200) * pixels_y,
+                            175 * pixels_x, 175 * pixels_y);
 
-            glUniform1i(0, window_w);
-            glUniform1i(1, window_h);
+                glBindTexture(GL_TEXTURE_2D, compositeTexture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, view.framebuffer_w, view.framebuffer_h, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, nullptr);
+            }
+            glUniform1i(2, strokeBounds.minX <= strokeBounds.maxX);
+            glUniform2i(4, viewLeft, viewBottom);
+            glUniform2i(5, inkTiles.tableX(), inkTiles.tableY());
 
+            glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, bgTexture);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(bgVertices), bgVertices, GL_STATIC_DRAW);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-
-            glBindTexture(GL_TEXTURE_2D, inkLayerTexture);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(bgVertices), bgVertices, GL_STATIC_DRAW);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, inkTiles.tiles());
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, strokeTexture);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, inkTiles.table());
+            glActiveTexture(GL_TEXTURE0);
+
+            // every layer at once, but only where something changed; the shader writes every pixel as it
+            // should end up, so nothing is blended or cleared first
+            glBindFramebuffer(GL_FRAMEBUFFER, compositeFbo);
+            glViewport(0, 0, view.framebuffer_w, view.framebuffer_h);
+            glBindVertexArray(compositeVao);
+            glDisable(GL_BLEND);
+            glEnable(GL_SCISSOR_TEST);
+            int damagedCount;
+            const st_damageRect *damaged = damage.rects(&damagedCount);
+            for (int i = 0; i < damagedCount; ++i) {
+                glScissor(damaged[i].x, damaged[i].y, damaged[i].w, damaged[i].h);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            glEnable(GL_BLEND);
+            glDisable(GL_SCISSOR_TEST);
+            damage.clear();
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, compositeFbo);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glBlitFramebuffer(0, 0, view.framebuffer_w, view.framebuffer_h, 0, 0, view.framebuffer_w,
+                              view.framebuffer_h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-            glBindTexture(GL_TEXTURE_2D, brushTexture);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(brushVertices), brushVertices, GL_STATIC_DRAW);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            // Nothing is predicted once packets stop coming, a pen resting in place shouldn't grow a tail.
+            predictedCount = 0;
+            const float ahead = (float) (PREDICTION_FRAMES * timePerFrame);
+            // while catching up the stroke is behind the pen, there's nothing to predict from
+            if (predict && caughtUp && now - lastPacketTime < ahead) {
+                strokePredictor.predict(strokeBuilder, ahead * 1000, predictedStamps);
+                predictedStamps.flush();
+            }
 
             glfwSwapBuffers(window);
+            renderedFrames++;
+            inkStamps.limit(STAMP_FRAME_BUDGET);
 
-            // std::cout << -lastRender + glfwGetTime() << std::endl;
+            // A predicted tip has to be redrawn or taken away next frame, even if nothing else happens. It
+            // isn't part of the composite, copying that over the back buffer is enough to take it away.
+            shouldRedraw = predictedCount > 0;
+        }
+
+        if (replayFast) {
+            glfwPollEvents();
+            // the last stamps still have to make it to the screen
+            if (inputThread.finished() && caughtUp && !shouldRedraw) {
+                glfwSetWindowShouldClose(window, true);
+            }
+        } else if (!caughtUp && !strokeEnded && inkStamps.room() > 0) {
+            // a new frame's budget is in, go on with the backlog right away
+            glfwPollEvents();
+        } else if (shouldRedraw || (tileDirectory && (panX != 0 || panY != 0))) {
+            // something is waiting to be composited, or the view keeps moving while an arrow key is held;
+            // sleep until the frame is due unless packets come first
+            const double untilFrame = lastRender + timePerFrame - glfwGetTime();
+            glfwWaitEventsTimeout(untilFrame > 0 ? untilFrame : 0);
         } else {
-            // std::cout << "skip" << std::endl;
+            // nothing to draw, sleep until a packet, a window event or a tile from the store comes in
+            glfwWaitEvents();
         }
+    }
+
+    inputThread.stop();
+    const st_inputStats inputStats = inputThread.stats();
+    std::cout << "Input: " << inputStats.received << " packets, " << inputStats.dropped << " dropped, ring high water "
+              << inputStats.highWater << "/" << inputStats.capacity << std::endl;
+    if (wintabSource) {
+        const st_queueMetrics &queue = wintabSource->metrics();
+        std::cout << "Wintab queue: " << queue.queueSize << " packets (grown " << queue.growths << " times), "
+                  << queue.fullDrains << " full drains, " << queue.dropped << " dropped, " << queue.late << " late, "
+                  << queue.drainInterval * 1000 << " ms between drains" << std::endl;
+    }
+
+    const st_filterStats &filterStats = packetFilter.stats();
+    std::cout << "Filter: " << filterStats.received << " packets, " << filterStats.forwarded << " after merging"
+              << std::endl;
+
+    const st_strokeTotals &strokeTotals = strokeBuilder.totals();
+    std::cout << "Strokes: " << strokeTotals.strokes << ", " << strokeTotals.samples << " samples ("
+              << strokeTotals.redundant << " redundant), " << strokeTotals.stamps << " stamps, "
+              << (double) strokeTotals.drawingTime / 1000 << " s drawn over " << (long long) strokeTotals.length
+              << " pixels, top speed " << strokeTotals.maxSpeed << " pixels/ms" << std::endl;
+    std::cout << "Stamp budget: ran out in " << budgetFrames << " frames, largest backlog " << backlogHighWater
+              << " points" << std::endl;
+    const st_damageStats &damageStats = damage.stats();
+    std::cout << "Composite: " << damageStats.frames << " frames redrawn (" << damageStats.fullFrames << " whole), "
+              << (double) damageStats.pixels / 1e6 << " megapixels" << std::endl;
+    std::cout << "Ink tiles: " << inkTiles.allocated() << " in use, " << (double) inkTiles.bytes() / (1024 * 1024)
+              << " MB allocated" << std::endl;
+    if (tileDirectory) {
+        const st_tileStoreStats storeStats = tileStore.stats();
+        std::cout << "Tile store: " << inkTiles.evicted() << " tiles evicted, " << storeStats.written << " written ("
+                  << storeStats.storedBytes / 1024 << " of " << storeStats.rawBytes / 1024 << " KB), "
+                  << storeStats.read << " read back" << std::endl;
+    }
 
-        glfwPollEvents();
+    if (replaySource) {
+        std::cout << "Replayed " << replaySource->packetCount() << " packets in " << glfwGetTime() - startTime
+                  << " s (" << renderedFrames << " frames)" << std::endl;
     }
 
-    glDeleteFramebuffers(1, &inkingFbo);
+    inkTiles.destroy();
+    tileStore.close();
+    glDeleteFramebuffers(1, &strokeFbo);
+    glDeleteFramebuffers(1, &compositeFbo);
+    glDeleteTextures(1, &strokeTexture);
+    glDeleteTextures(1, &compositeTexture);
     glDeleteVertexArrays(1, &vao);
-    glDeleteVertexArrays(1, &bgVao);
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &bgVbo);
+    glDeleteVertexArrays(1, &capsuleVao);
+    glDeleteVertexArrays(1, &compositeVao);
+    glDeleteVertexArrays(1, &strokeVao);
+    stampBuffer.destroy();
+    glDeleteBuffers(1, &strokeVbo);
     glDeleteProgram(mainProgram);
-    glDeleteProgram(bgProgram);
+    glDeleteProgram(compositeProgram);
+    glDeleteProgram(stampComputeProgram);
+    glDeleteProgram(capsuleProgram);
+    glDeleteProgram(strokeCommitProgram);
 
-    gpWTClose(hctx);
-    UnloadWintab();
+    packetSource = nullptr;
     glfwTerminate();
 
     return 0;
@@ -0,0 +1,25 @@
+#version 430 core
+in vec2 canvasPos;
+flat in vec4 segment;
+flat in vec2 radii;
+
+out vec4 color;
+
+layout (location = 9) uniform float brushHardness;
+layout (location = 10) uniform bool coverageOnly;  // see fragment.glsl
+
+void main(){
+    vec2 from = segment.xy;
+    vec2 along = segment.zw - from;
+    float t = clamp(dot(canvasPos - from, along) / max(dot(along, along), 1e-6), 0.0, 1.0);
+    float radius = mix(radii.x, radii.y, t);
+    float y = distance(canvasPos, from + along * t);
+    if (y >= radius) {
+        discard;
+    }
+
+    // Stamps in a stroke take the max of their coverage, so a densely stamped line is covered by its
+    // closest stamp: the fragment.glsl falloff y pixels out.
+    float coverage = clamp((1 - y * y / (radius * radius)) * brushHardness, 0.0, 1.0);
+    color = coverageOnly ? vec4(coverage) : vec4(0.1, 0.1, 0.1, coverage);
+}
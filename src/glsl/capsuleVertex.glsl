@@ -0,0 +1,43 @@
+#version 430 core
+// one instance per capsule, its two ends are consecutive stamps
+layout (location = 0) in vec3 inkFrom;
+layout (location = 1) in vec3 inkTo;
+
+layout (location = 0) uniform int canvas_w;
+layout (location = 1) uniform int canvas_h;
+
+layout (location = 2) uniform int maxPressure;
+layout (location = 3) uniform float inkMinSize;
+layout (location = 4) uniform float inkMaxSize;
+
+layout (location = 8) uniform float brushRadius;
+
+out vec2 canvasPos;
+flat out vec4 segment;  // from, to in canvas pixels
+flat out vec2 radii;
+
+void main() {
+    // how far the brush reaches from a stamp's center, see fragment.glsl
+    float fromRadius = (inkMinSize + inkFrom.z * (inkMaxSize - inkMinSize) / maxPressure) * brushRadius;
+    float toRadius = (inkMinSize + inkTo.z * (inkMaxSize - inkMinSize) / maxPressure) * brushRadius;
+    float radius = max(fromRadius, toRadius);
+
+    vec2 along = inkTo.xy - inkFrom.xy;
+    float len = length(along);
+    along = len > 0 ? along / len : vec2(1, 0);
+    vec2 across = vec2(-along.y, along.x);
+
+    // a box around both end circles, drawn as a 4 vertex triangle strip:
+    // 0 behind the start, right side, 1 past the end, right side, 2 and 3 the same on the left
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    canvasPos = inkFrom.xy + along * (corner.x * (len + 2 * radius) - radius) + across * (corner.y * 2 - 1) * radius;
+    segment = vec4(inkFrom.xy, inkTo.xy);
+    radii = vec2(fromRadius, toRadius);
+
+    int canvasHalfWidth = canvas_w / 2;
+    int canvasHalfHeight = canvas_h / 2;
+    float x = (canvasPos.x - canvasHalfWidth) / canvasHalfWidth;
+    float y = -(canvasPos.y - canvasHalfHeight) / canvasHalfHeight;
+
+    gl_Position = vec4(x, y, 0.0, 1.0);
+}
@@ -0,0 +1,83 @@
+#version 430 core
+// Everything in the window in one pass: the background, the ink layer and the stroke in progress over it,
+// and the brush preview. Rectangles are in framebuffer pixels from the bottom left: x, y, width, height.
+out vec4 color;
+
+layout (binding = 0) uniform sampler2D background;
+layout (binding = 1) uniform sampler2DArray inkTiles;   // coverage only, the ink is all inkColor
+layout (binding = 2) uniform sampler2D strokeCoverage;  // see strokeFragment.glsl
+layout (binding = 3) uniform isampler2D tileTable;      // layer of inkTiles holding each tile, -1 for none
+
+layout (location = 0) uniform vec4 canvasRect;
+layout (location = 1) uniform vec4 previewRect;
+layout (location = 2) uniform bool stroking;  // strokeCoverage has something in it
+layout (location = 3) uniform ivec2 canvasSize;  // ink layer pixels
+layout (location = 4) uniform ivec2 viewOrigin;  // ink layer pixel at the bottom left of the canvas
+layout (location = 5) uniform ivec2 tableOrigin;  // tile at the bottom left of tileTable
+
+// same brush as fragment.glsl
+layout (location = 8) uniform float brushRadius;
+layout (location = 9) uniform float brushHardness;
+
+const vec3 inkColor = vec3(0.1, 0.1, 0.1);
+const int tileSize = 256;  // INK_TILE_SIZE
+
+// Tile of an ink layer pixel, rounding down on both sides of the origin.
+ivec2 tileOf(ivec2 texel) {
+    return ivec2(floor(vec2(texel) / tileSize));
+}
+
+// Layer of the tile, -1 if it has none or the table doesn't reach it.
+int tileLayer(ivec2 tile) {
+    ivec2 entry = tile - tableOrigin;
+    if (any(lessThan(entry, ivec2(0))) || any(greaterThanEqual(entry, textureSize(tileTable, 0)))) {
+        return -1;
+    }
+    return texelFetch(tileTable, entry, 0).r;
+}
+
+float inkTexel(ivec2 texel) {
+    ivec2 tile = tileOf(texel);
+    int layer = tileLayer(tile);
+    return layer < 0 ? 0.0 : texelFetch(inkTiles, ivec3(texel - tile * tileSize, layer), 0).r;
+}
+
+// The ink layer filtered as if it were one texture. When all four texels the filter reads are in one tile
+// the hardware does it, across tile edges they are read one by one.
+float inkCoverage(vec2 canvasUv) {
+    vec2 texel = canvasUv * vec2(canvasSize) + vec2(viewOrigin) - 0.5;
+    ivec2 first = ivec2(floor(texel));
+    ivec2 tile = tileOf(first);
+    if (tileOf(first + 1) == tile) {
+        int layer = tileLayer(tile);
+        if (layer < 0) {
+            return 0.0;
+        }
+        return texture(inkTiles, vec3((texel + 0.5 - vec2(tile * tileSize)) / tileSize, layer)).r;
+    }
+    vec2 f = texel - vec2(first);
+    float below = mix(inkTexel(first), inkTexel(first + ivec2(1, 0)), f.x);
+    float above = mix(inkTexel(first + ivec2(0, 1)), inkTexel(first + ivec2(1, 1)), f.x);
+    return mix(below, above, f.y);
+}
+
+void main(){
+    vec2 canvasUv = (gl_FragCoord.xy - canvasRect.xy) / canvasRect.zw;
+    color = vec4(0);
+    if (all(greaterThanEqual(canvasUv, vec2(0))) && all(lessThan(canvasUv, vec2(1)))) {
+        // the background repeats once the view moves off it
+        color = texture(background, canvasUv + vec2(viewOrigin) / vec2(canvasSize));
+        color.rgb = mix(color.rgb, inkColor, inkCoverage(canvasUv));
+        if (stroking) {
+            color.rgb = mix(color.rgb, inkColor, texture(strokeCoverage, canvasUv).r);
+        }
+    }
+
+    vec2 previewUv = (gl_FragCoord.xy - previewRect.xy) / previewRect.zw;
+    if (all(greaterThanEqual(previewUv, vec2(0))) && all(lessThan(previewUv, vec2(1)))) {
+        vec2 offset = previewUv - 0.5;
+        float falloff = 1 - dot(offset, offset) / (brushRadius * brushRadius);
+        float alpha = clamp(falloff * brushHardness, 0.0, 1.0);
+        color = vec4(mix(color.rgb, inkColor, alpha), max(color.a, alpha));
+    }
+}
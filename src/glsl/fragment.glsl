@@ -3,8 +3,13 @@ in vec2 uv;
 
 out vec4 color;
 
-uniform sampler2D tex;
+layout (location = 8) uniform float brushRadius;    // in uv units, 0.5 reaches the edge of the stamp
+layout (location = 9) uniform float brushHardness;  // 1 fades out evenly with the squared distance
+layout (location = 10) uniform bool coverageOnly;   // drawing into the stroke coverage buffer, see strokeFragment.glsl
 
 void main(){
-    color = vec4(0.1, 0.1, 0.1, texture(tex, uv).x);
+    vec2 offset = uv - 0.5;
+    float falloff = 1 - dot(offset, offset) / (brushRadius * brushRadius);
+    float alpha = clamp(falloff * brushHardness, 0.0, 1.0);
+    color = coverageOnly ? vec4(alpha) : vec4(0.1, 0.1, 0.1, alpha);
 }
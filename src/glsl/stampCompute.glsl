@@ -0,0 +1,81 @@
+#version 430 core
+// Rasterizes a batch of stamps into the stroke coverage buffer, one 16x16 tile per work group.
+// The group loads the stamps 256 at a time, keeps those touching its tile in shared memory, then every
+// invocation takes the max of their coverage over its own pixel in registers and writes the pixel back once.
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (r8, binding = 0) uniform image2D strokeCoverage;
+
+layout (std430, binding = 0) readonly buffer Stamps {
+    float stamps[];  // st_inkData: x, y, size
+};
+
+layout (location = 0) uniform int canvas_w;
+layout (location = 1) uniform int canvas_h;
+
+layout (location = 2) uniform int maxPressure;
+layout (location = 3) uniform float inkMinSize;
+layout (location = 4) uniform float inkMaxSize;
+
+layout (location = 5) uniform int firstStamp;
+layout (location = 6) uniform int stampCount;
+layout (location = 7) uniform ivec2 tileOrigin;
+
+// same brush as fragment.glsl
+layout (location = 8) uniform float brushRadius;
+layout (location = 9) uniform float brushHardness;
+
+shared vec4 tileStampRects[256];  // left, bottom, right, top in pixels
+shared uint tileStampCount;
+
+void main() {
+    ivec2 tileMin = tileOrigin + ivec2(gl_WorkGroupID.xy) * 16;
+    ivec2 pixel = tileMin + ivec2(gl_LocalInvocationID.xy);
+    bool inside = pixel.x < canvas_w && pixel.y < canvas_h;
+    vec2 center = vec2(pixel) + 0.5;
+
+    float coverage = inside ? imageLoad(strokeCoverage, pixel).r : 0;
+
+    int canvasHalfWidth = canvas_w / 2;
+    int canvasHalfHeight = canvas_h / 2;
+
+    for (int chunk = 0; chunk < stampCount; chunk += 256) {
+        if (gl_LocalInvocationIndex == 0) {
+            tileStampCount = 0;
+        }
+        barrier();
+
+        // same quad as vertex.glsl, taken through normalized device coordinates to pixels
+        int stamp = chunk + int(gl_LocalInvocationIndex);
+        if (stamp < stampCount) {
+            int base = (firstStamp + stamp) * 3;
+            float halfInkSize = (inkMinSize + stamps[base + 2] * (inkMaxSize - inkMinSize) / maxPressure) / 2;
+            vec2 ndcCenter = vec2((stamps[base] - canvasHalfWidth) / canvasHalfWidth,
+                                  -(stamps[base + 1] - canvasHalfHeight) / canvasHalfHeight);
+            vec2 ndcHalf = vec2(halfInkSize / canvasHalfWidth, halfInkSize / canvasHalfHeight);
+            vec2 size = vec2(canvas_w, canvas_h);
+            vec4 rect = vec4((ndcCenter - ndcHalf + 1) * size / 2, (ndcCenter + ndcHalf + 1) * size / 2);
+
+            if (rect.x < tileMin.x + 16 && rect.z > tileMin.x && rect.y < tileMin.y + 16 && rect.w > tileMin.y) {
+                uint slot = atomicAdd(tileStampCount, 1);
+                tileStampRects[slot] = rect;
+            }
+        }
+        barrier();
+
+        for (uint i = 0; i < tileStampCount; ++i) {
+            vec4 rect = tileStampRects[i];
+            if (center.x >= rect.x && center.x < rect.z && center.y >= rect.y && center.y < rect.w) {
+                vec2 offset = (center - rect.xy) / (rect.zw - rect.xy) - 0.5;
+                float falloff = 1 - dot(offset, offset) / (brushRadius * brushRadius);
+                float alpha = clamp(falloff * brushHardness, 0.0, 1.0);
+                coverage = max(coverage, alpha);
+            }
+        }
+        barrier();
+    }
+
+    if (inside) {
+        imageStore(strokeCoverage, pixel, vec4(coverage));
+    }
+}
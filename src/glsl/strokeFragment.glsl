@@ -0,0 +1,13 @@
+#version 430 core
+in vec2 uv;
+
+out vec4 color;
+
+// Coverage of the stroke in progress. Its stamps take the max of their coverage instead of blending over
+// each other, so overlapping stamps don't darken the stroke. It's added to the ink layer's coverage like a
+// single stamp once the stroke ends, until then compositeFragment.glsl draws it over the ink layer.
+uniform sampler2D strokeCoverage;
+
+void main(){
+    color = vec4(texture(strokeCoverage, uv).r);
+}
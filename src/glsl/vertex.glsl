@@ -1,6 +1,5 @@
 #version 430 core
 layout (location = 0) in vec3 inkPoint;
-layout (location = 1) in int index;
 
 layout (location = 0) uniform int canvas_w;
 layout (location = 1) uniform int canvas_h;
@@ -20,23 +19,13 @@ void main() {
     float halfInkSize = (inkMinSize + inkPoint.z * (inkMaxSize - inkMinSize) / maxPressure) / 2;
     float x = offset_x;
     float y = -offset_y;
-    if (index == 1) {
-        x = (x - halfInkSize) / canvasHalfWidth;
-        y = (y + halfInkSize) / canvasHalfHeight;
-        uv = vec2(0, 1);
-    } else if (index == 2) {
-        x = (x - halfInkSize) / canvasHalfWidth;
-        y = (y - halfInkSize) / canvasHalfHeight;
-        uv = vec2(0, 0);
-    } else if (index == 3) {
-        x = (x + halfInkSize) / canvasHalfWidth;
-        y = (y - halfInkSize) / canvasHalfHeight;
-        uv = vec2(1, 0);
-    } else {
-        x = (x + halfInkSize) / canvasHalfWidth;
-        y = (y + halfInkSize) / canvasHalfHeight;
-        uv = vec2(1, 1);
-    }
+
+    // one instance per stamp, drawn as a 4 vertex triangle strip:
+    // 0 bottom left, 1 bottom right, 2 top left, 3 top right
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    x = (x + (corner.x * 2 - 1) * halfInkSize) / canvasHalfWidth;
+    y = (y + (corner.y * 2 - 1) * halfInkSize) / canvasHalfHeight;
+    uv = corner;
 
     gl_Position = vec4(x, y, 0.0, 1.0);
 }